@@ -0,0 +1,3124 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* benchmarks every implementation compiled in for this platform side by side.
+   this file includes memcnt.c with the dynamic dispatcher (so that every
+   implementation is compiled in) and thus should be compiled on its own.
+   implementations not supported by the CPU are skipped.
+
+   usage: bench-memcnt [options]
+      -m mode               what to measure (default throughput):
+                              throughput times back-to-back calls over each
+                                combination of size, alignment and value
+                              latency times calls that each depend on the
+                                result of the previous one, with warm caches
+                                and with the buffer flushed from the cache
+                                (cold) before each call
+                              counters reads hardware performance counters
+                                with perf_event_open (Linux only) over the
+                                same combinations as throughput and reports
+                                cycles, instructions, L1D and LLC read
+                                misses and branch misses per call,
+                                instructions per cycle and bytes per miss
+                              hierarchy measures working sets resident in
+                                L1, L2, the last-level cache and DRAM (or
+                                the sizes given with -s, rounded down to a
+                                multiple of 64) against a read bandwidth
+                                ceiling measured at the same size, and
+                                reports each implementation as a percentage
+                                of the ceiling. values default to sparse
+                                and alignments are ignored
+                              threads runs the fastest implementation (or
+                                those given with -i) from several threads
+                                at once, each on its own buffer and all on
+                                one shared buffer, placing the threads on
+                                separate cores first (spread) or on SMT
+                                siblings first (packed), and reports the
+                                total bandwidth and how much slower each
+                                thread is than with the first thread count
+                                (normally running alone). default
+                                sizes are 256 KiB and 16 MiB per thread,
+                                only the first value is used and alignments
+                                are ignored
+                              parallel counts one large buffer (default
+                                256 MiB, spread over the NUMA nodes in 2 MiB
+                                segments unless bound with -n) with several
+                                threads at once, split evenly among them
+                                (even) or taken in chunks from a queue per
+                                NUMA node by the threads on that node, which
+                                take from other nodes only when their own
+                                runs out (topology). chunks shrink as the
+                                queue empties and are smaller for slower
+                                cores (such as E-cores), so that the threads
+                                finish together. reports the total
+                                bandwidth, the share of bytes read from the
+                                node of the reading thread and how long the
+                                threads wait for the slowest one
+                              stdin counts the newlines of standard input
+                                (like wc -l) with the fastest implementation
+                                (or the first given with -i) and reports
+                                how fast it was read, such as
+                                zcat file.gz | bench-memcnt -m stdin.
+                                gzip and zstd input is decompressed on the
+                                fly if built with -DBENCH_ZLIB=1 -lz or
+                                -DBENCH_ZSTD=1 -lzstd, so that
+                                bench-memcnt -m stdin < file.gz also works.
+                                see -I
+      -f table|csv|json     output format (default table)
+      -i impl,impl,...      only benchmark these implementations
+      -s size,size,...      buffer sizes in bytes, lo-hi for a range
+                              (default for latency: 0-1024)
+      -a align,align,...    offsets from a 64-byte aligned address, lo-hi for
+                              a range (default for latency: 0-63)
+      -v none,sparse,all    which values to count: one that does not appear,
+                              one that appears in ~1/255 of bytes, or one
+                              that every byte is equal to
+                              (throughput and counters; latency uses sparse)
+      -r repeats            timed samples per measurement
+                              (default 31 for throughput, 11 for counters,
+                              7 for latency)
+      -w warmups            untimed batches before sampling (default 3)
+      -c cpu                pin to this CPU (default: the current one)
+      -e name=config,...    with -m counters, also count these raw PMU
+                              events, such as the AVX frequency licenses on
+                              Intel Skylake-SP and later:
+                              -e lic1=0x1828,lic2=0x2028
+                              (CORE_POWER.LVL1/LVL2_TURBO_LICENSE, cycles
+                              spent at the AVX2 and AVX-512 license)
+      -o file               with -m throughput, write the results into a
+                              baseline file
+      -b file               with -m throughput, compare against a baseline
+                              file instead. measurements whose median is
+                              more than the tolerance off from the baseline
+                              are repeated until the 95% confidence intervals
+                              of the medians separate (or up to 8 times the
+                              samples); a separated slowdown is reported as
+                              "slower" and the exit status is then 3
+      -t percent            tolerance for -b (default 5)
+      -p small|huge         page size for the buffers (Linux only); huge
+                              uses reserved 2 MB pages if there are any
+                              and transparent huge pages otherwise
+      -n local|remote|node  bind the buffers to the NUMA node of the CPU,
+                              some other node, or the given node
+                              (Linux only)
+      -T threads,...        thread counts for -m threads and parallel,
+                              lo-hi for a range
+                              (default 1, 2, 4, ... and the number of CPUs)
+      -I read|ring          how -m stdin reads: read() (and decompress)
+                              64 KiB at a time and count (read), or let a
+                              thread read into a ring of 1 MiB buffers
+                              (256 KiB for decompressed data, to stay in
+                              the cache) while the counting thread counts
+                              the previous ones, with the pipe enlarged to
+                              1 MiB where possible (ring, the default).
+                              either way, an uncompressed regular file is
+                              mapped into memory and counted in place
+
+   on POSIX systems other than Linux with glibc 2.34 or later, link with
+   -pthread.
+*/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#undef MEMCNT_DYNAMIC
+#define MEMCNT_DYNAMIC 1
+#include "memcnt.h"
+#include "memcnt.c"
+
+#if !MEMCNT_MULTIARCH
+#error bench-memcnt.c needs a compiler that supports multiple implementations
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#define IS_POSIX 1
+#elif defined(__unix__) || defined(__unix) ||                                  \
+    (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#define IS_POSIX 1
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#define IS_WINDOWS 1
+#endif
+
+/* =============================
+              timers
+   ============================= */
+
+/* ticks are CPU (reference) cycles where we can read them, and otherwise
+   whatever the fastest available timer counts in */
+typedef unsigned long long ticks_t;
+
+#if (defined(__i386__) || defined(__amd64__) || defined(_M_IX86) ||            \
+     defined(_M_X64))
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TICK_METHOD "x86 rdtsc"
+#define TICK_CYCLES 1
+static ticks_t getticks(void) {
+    ticks_t x;
+    _mm_lfence();
+    x = __rdtsc();
+    _mm_lfence();
+    return x;
+}
+#elif defined(__aarch64__)
+#define TICK_METHOD "ARM cntvct_el0"
+#define TICK_CYCLES 0
+static ticks_t getticks(void) {
+    ticks_t x;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(x));
+    return x;
+}
+#elif IS_WINDOWS
+#define TICK_METHOD "Win32 QueryPerformanceCounter"
+#define TICK_CYCLES 0
+static ticks_t getticks(void) {
+    LARGE_INTEGER r;
+    QueryPerformanceCounter(&r);
+    return (ticks_t)r.QuadPart;
+}
+#elif IS_POSIX
+#define TICK_METHOD "POSIX clock_gettime(CLOCK_MONOTONIC)"
+#define TICK_CYCLES 0
+static ticks_t getticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ticks_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#else
+#define TICK_METHOD "C clock()"
+#define TICK_CYCLES 0
+static ticks_t getticks(void) { return (ticks_t)clock(); }
+#endif
+
+/* evicting a buffer from the caches, for cold measurements */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) ||              \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAN_FLUSH 1
+static void flush_cache(const void *ptr, size_t n) {
+    const char *p = (const char *)((uintptr_t)ptr & ~(uintptr_t)63),
+               *e = (const char *)ptr + n;
+    for (; p < e; p += 64)
+        _mm_clflush(p);
+    _mm_mfence();
+}
+#elif defined(__aarch64__) && defined(__GNUC__)
+#define CAN_FLUSH 1
+static void flush_cache(const void *ptr, size_t n) {
+    const char *p = (const char *)((uintptr_t)ptr & ~(uintptr_t)63),
+               *e = (const char *)ptr + n;
+    for (; p < e; p += 64)
+        __asm__ __volatile__("dc civac, %0" : : "r"(p) : "memory");
+    __asm__ __volatile__("dsb ish" : : : "memory");
+}
+#else
+#define CAN_FLUSH 0
+static void flush_cache(const void *ptr, size_t n) {
+    (void)ptr;
+    (void)n;
+}
+#endif
+
+/* returns the time since some point in seconds, for calibrating ticks */
+static double getseconds(void) {
+#if IS_WINDOWS
+    LARGE_INTEGER r, f;
+    QueryPerformanceCounter(&r);
+    QueryPerformanceFrequency(&f);
+    return (double)r.QuadPart / (double)f.QuadPart;
+#elif IS_POSIX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static double calibrate_ticks_per_second(void) {
+    double s0 = getseconds(), s1;
+    ticks_t t0 = getticks(), t1;
+    do
+        s1 = getseconds();
+    while (s1 - s0 < 0.1);
+    t1 = getticks();
+    return (t1 - t0) / (s1 - s0);
+}
+
+static int pin_cpu(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    if (cpu < 0)
+        cpu = sched_getcpu();
+    if (cpu < 0)
+        return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set))
+        return -1;
+    return cpu;
+#elif IS_WINDOWS
+    if (cpu < 0)
+        cpu = (int)GetCurrentProcessorNumber();
+    if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu))
+        return -1;
+    return cpu;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+/* =============================
+          implementations
+   ============================= */
+
+typedef size_t (*bench_fn_t)(const void *, int, size_t);
+
+struct bench_impl {
+    const char *name;
+    bench_fn_t fn;
+};
+
+#define MAX_IMPLS 16
+static struct bench_impl impls[MAX_IMPLS];
+static int impl_count = 0;
+
+static void add_impl(const char *name, bench_fn_t fn, int supported) {
+    if (supported && impl_count < MAX_IMPLS) {
+        impls[impl_count].name = name;
+        impls[impl_count].fn = fn;
+        ++impl_count;
+    }
+}
+
+#define BENCH_IMPL(x) add_impl(#x, &MEMCNT_NAME(x), MEMCNT_DCHECK_##x)
+
+static void find_impls(void) {
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+    BENCH_IMPL(avx512);
+#endif
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+    BENCH_IMPL(avx2);
+#endif
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+    BENCH_IMPL(sse2);
+#endif
+#if MEMCNT_COMPILED_neon && defined(MEMCNT_DCHECK_neon)
+    BENCH_IMPL(neon);
+#endif
+#if MEMCNT_COMPILED_wasm_simd && defined(MEMCNT_DCHECK_wasm_simd)
+    BENCH_IMPL(wasm_simd);
+#endif
+#if MEMCNT_WIDE
+    add_impl("wide", &MEMCNT_NAME(wide), 1);
+#endif
+    add_impl("default", &MEMCNT_NAME(default), 1);
+}
+
+/* =============================
+           measurement
+   ============================= */
+
+#define MAX_LIST 4096
+#define MIN_BATCH_TICKS 20000
+#define LATENCY_CHAIN 64
+/* at most this many times the requested samples when comparing against a
+   baseline */
+#define MAX_RESAMPLE 8
+
+enum bench_value { VALUE_NONE, VALUE_SPARSE, VALUE_ALL, VALUE_COUNT };
+static const char *value_names[VALUE_COUNT] = {"none", "sparse", "all"};
+
+struct bench_result {
+    double median, p99; /* ticks per call */
+};
+
+static volatile size_t sink;
+/* always zero, but the compiler does not know that */
+static volatile size_t zero;
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* picks the nearest-rank percentile from a sorted array */
+static double percentile(const double *v, int n, int pct) {
+    int i = (n * pct + 99) / 100 - 1;
+    return v[i < 0 ? 0 : i];
+}
+
+/* an approximate 95% confidence interval for the median of a sorted array,
+   between the order statistics n/2 -+ 0.98 sqrt(n). this needs no
+   assumptions about the distribution of the samples */
+static void median_ci(const double *v, int n, double *lo, double *hi) {
+    int h = 0, a, b;
+    while ((double)h * h < 0.9604 * n)
+        ++h;
+    a = (n - 1) / 2 - h;
+    b = n / 2 + h;
+    *lo = v[a < 0 ? 0 : a];
+    *hi = v[b >= n ? n - 1 : b];
+}
+
+static ticks_t time_batch(bench_fn_t fn, const unsigned char *p, int c,
+                          size_t n, unsigned long iters) {
+    unsigned long i;
+    size_t s = 0;
+    ticks_t t0, t1;
+    t0 = getticks();
+    for (i = 0; i < iters; ++i)
+        s += fn(p, c, n);
+    t1 = getticks();
+    sink += s;
+    return t1 - t0;
+}
+
+/* grows the batch until the timer overhead is negligible */
+static unsigned long batch_iters(bench_fn_t fn, const unsigned char *p, int c,
+                                 size_t n) {
+    unsigned long iters = 1;
+    while (time_batch(fn, p, c, n, iters) < MIN_BATCH_TICKS &&
+           iters < (1UL << 24))
+        iters *= 2;
+    return iters;
+}
+
+static struct bench_result measure(bench_fn_t fn, const unsigned char *p,
+                                   int c, size_t n, int warmups, int repeats,
+                                   double *samples) {
+    struct bench_result r;
+    unsigned long iters = batch_iters(fn, p, c, n);
+    int i;
+    for (i = 0; i < warmups; ++i)
+        time_batch(fn, p, c, n, iters);
+    for (i = 0; i < repeats; ++i)
+        samples[i] = (double)time_batch(fn, p, c, n, iters) / iters;
+    qsort(samples, repeats, sizeof(double), compare_double);
+    r.median = percentile(samples, repeats, 50);
+    r.p99 = percentile(samples, repeats, 99);
+    return r;
+}
+
+/* returns the median of the smallest possible timed interval */
+static double measure_timer_overhead(double *samples, int repeats) {
+    int i;
+    for (i = 0; i < repeats; ++i) {
+        ticks_t t0 = getticks();
+        samples[i] = (double)(getticks() - t0);
+    }
+    qsort(samples, repeats, sizeof(double), compare_double);
+    return percentile(samples, repeats, 50);
+}
+
+/* time per call when every call depends on the result of the previous one,
+   so that they cannot overlap; the timer overhead is spread over
+   LATENCY_CHAIN calls */
+static double measure_latency_warm(bench_fn_t fn, const unsigned char *p,
+                                   int c, size_t n, int warmups, int repeats,
+                                   double *samples) {
+    size_t mask = zero, r = 0;
+    int i, k;
+    for (i = -warmups; i < repeats; ++i) {
+        ticks_t t0, t1;
+        t0 = getticks();
+        for (k = 0; k < LATENCY_CHAIN; ++k)
+            r = fn(p + (r & mask), c, n);
+        t1 = getticks();
+        if (i >= 0)
+            samples[i] = (double)(t1 - t0) / LATENCY_CHAIN;
+    }
+    sink += r;
+    qsort(samples, repeats, sizeof(double), compare_double);
+    return percentile(samples, repeats, 50);
+}
+
+/* time for a single call with the buffer evicted from the caches, minus the
+   timer overhead */
+static double measure_latency_cold(bench_fn_t fn, const unsigned char *p,
+                                   int c, size_t n, int repeats,
+                                   double overhead, double *samples) {
+    size_t r = 0;
+    int i;
+    for (i = 0; i < repeats; ++i) {
+        ticks_t t0, t1;
+        flush_cache(p, n);
+        t0 = getticks();
+        r += fn(p, c, n);
+        t1 = getticks();
+        samples[i] = (double)(t1 - t0) - overhead;
+        if (samples[i] < 0)
+            samples[i] = 0;
+    }
+    sink += r;
+    qsort(samples, repeats, sizeof(double), compare_double);
+    return percentile(samples, repeats, 50);
+}
+
+/* =============================
+         hardware counters
+   ============================= */
+
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__linux__) && defined(SYS_perf_event_open)
+#define CAN_COUNT 1
+#else
+#define CAN_COUNT 0
+#endif
+
+/* the first counters are always the same, any raw events given with -e are
+   added after them */
+enum bench_counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_BUILTIN
+};
+#define MAX_COUNTERS 12
+#define MAX_COUNTER_NAME 16
+
+struct bench_counter_def {
+    char name[MAX_COUNTER_NAME];
+    int slot; /* index in the group read, -1 if not available */
+};
+static struct bench_counter_def counters[MAX_COUNTERS];
+static int counter_count;
+
+#if CAN_COUNT
+static int counter_leader = -1, counter_slots = 0;
+
+static int perf_open(unsigned type, unsigned long long config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/* all counters are in one group so that they count over exactly the same
+   instructions. a counter the PMU does not have (or cannot fit in the group)
+   is reported as not available */
+static int add_counter(const char *name, unsigned type,
+                       unsigned long long config) {
+    struct bench_counter_def *d = &counters[counter_count];
+    int fd;
+    if (counter_count >= MAX_COUNTERS)
+        return -1;
+    fd = perf_open(type, config, counter_leader);
+    strncpy(d->name, name, MAX_COUNTER_NAME - 1);
+    d->name[MAX_COUNTER_NAME - 1] = 0;
+    d->slot = -1;
+    ++counter_count;
+    if (fd < 0)
+        return -1;
+    if (counter_leader < 0)
+        counter_leader = fd;
+    d->slot = counter_slots++;
+    return 0;
+}
+
+#define PERF_CACHE(cache, op, result)                                          \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+/* raw_events is a list of name=config pairs */
+static int open_counters(const char *raw_events) {
+    if (add_counter("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES)) {
+        fprintf(stderr,
+                "perf_event_open: %s\nhardware counters are not available "
+                "(check /proc/sys/kernel/perf_event_paranoid; virtual "
+                "machines may not expose a PMU)\n",
+                strerror(errno));
+        return -1;
+    }
+    add_counter("instrs", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    add_counter("l1d-miss", PERF_TYPE_HW_CACHE,
+                PERF_CACHE(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS));
+    add_counter("llc-miss", PERF_TYPE_HW_CACHE,
+                PERF_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS));
+    add_counter("br-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    while (raw_events && *raw_events) {
+        char name[MAX_COUNTER_NAME], *e;
+        const char *eq = strchr(raw_events, '=');
+        unsigned long long config;
+        size_t l = eq ? (size_t)(eq - raw_events) : 0;
+        if (!l || l >= MAX_COUNTER_NAME)
+            return -2;
+        memcpy(name, raw_events, l);
+        name[l] = 0;
+        config = strtoull(eq + 1, &e, 0);
+        if (e == eq + 1 || (*e && *e != ','))
+            return -2;
+        if (counter_count >= MAX_COUNTERS) {
+            fputs("warning: too many events\n", stderr);
+            break;
+        }
+        if (add_counter(name, PERF_TYPE_RAW, config))
+            fprintf(stderr, "warning: could not count raw event %s (%s)\n",
+                    name, strerror(errno));
+        raw_events = *e ? e + 1 : e;
+    }
+    return 0;
+}
+
+/* runs a batch with the counters enabled and stores the count per call for
+   every counter, or -1 for counters that are not available */
+static void count_batch(bench_fn_t fn, const unsigned char *p, int c, size_t n,
+                        unsigned long iters, double *out) {
+    unsigned long long data[3 + MAX_COUNTERS];
+    unsigned long i;
+    size_t s = 0;
+    double scale = 0;
+    int k;
+    ioctl(counter_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counter_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    for (i = 0; i < iters; ++i)
+        s += fn(p, c, n);
+    ioctl(counter_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    sink += s;
+    /* if the group was multiplexed with other users of the PMU, scale the
+       counts up to the whole time it was enabled */
+    if (read(counter_leader, data, sizeof(data)) > 0 && data[2] > 0)
+        scale = (double)data[1] / data[2] / iters;
+    for (k = 0; k < counter_count; ++k)
+        out[k] = counters[k].slot >= 0 && scale > 0
+                     ? data[3 + counters[k].slot] * scale
+                     : -1;
+}
+
+/* stores the median count per call for every counter */
+static void measure_counters(bench_fn_t fn, const unsigned char *p, int c,
+                             size_t n, int warmups, int repeats,
+                             double *samples, double *out) {
+    double counts[MAX_COUNTERS];
+    unsigned long iters = batch_iters(fn, p, c, n);
+    int i, k;
+    for (i = 0; i < warmups; ++i)
+        time_batch(fn, p, c, n, iters);
+    for (i = 0; i < repeats; ++i) {
+        count_batch(fn, p, c, n, iters, counts);
+        for (k = 0; k < counter_count; ++k)
+            samples[k * repeats + i] = counts[k];
+    }
+    for (k = 0; k < counter_count; ++k) {
+        qsort(samples + k * repeats, repeats, sizeof(double), compare_double);
+        out[k] = percentile(samples + k * repeats, repeats, 50);
+    }
+}
+#else
+static int open_counters(const char *raw_events) {
+    (void)raw_events;
+    fputs("hardware counters are only supported on Linux\n", stderr);
+    return -1;
+}
+
+static void measure_counters(bench_fn_t fn, const unsigned char *p, int c,
+                             size_t n, int warmups, int repeats,
+                             double *samples, double *out) {
+    (void)fn, (void)p, (void)c, (void)n, (void)warmups, (void)repeats;
+    (void)samples, (void)out;
+}
+#endif
+
+/* =============================
+             baselines
+   ============================= */
+
+/* a baseline file has one line per measurement:
+       impl size align value median_ns ci_lo_ns ci_hi_ns
+   and lines starting with # are comments */
+
+struct bench_baseline {
+    char impl[16], value[8];
+    size_t size, align;
+    double median, lo, hi; /* nanoseconds per call */
+};
+static struct bench_baseline *baselines;
+static int baseline_count;
+
+static int load_baselines(const char *fn) {
+    char line[256];
+    int cap = 0;
+    FILE *f = fopen(fn, "r");
+    if (!f) {
+        perror(fn);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        struct bench_baseline b;
+        unsigned long size, align;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%15s %lu %lu %7s %lf %lf %lf", b.impl, &size,
+                   &align, b.value, &b.median, &b.lo, &b.hi) != 7) {
+            fprintf(stderr, "%s: bad line: %s", fn, line);
+            fclose(f);
+            return -1;
+        }
+        b.size = size;
+        b.align = align;
+        if (baseline_count == cap) {
+            struct bench_baseline *nb;
+            cap = cap ? cap * 2 : 64;
+            nb = realloc(baselines, cap * sizeof(*baselines));
+            if (!nb) {
+                fclose(f);
+                return -1;
+            }
+            baselines = nb;
+        }
+        baselines[baseline_count++] = b;
+    }
+    fclose(f);
+    return 0;
+}
+
+static const struct bench_baseline *find_baseline(const char *impl,
+                                                  size_t size, size_t align,
+                                                  const char *value) {
+    int i;
+    for (i = 0; i < baseline_count; ++i)
+        if (baselines[i].size == size && baselines[i].align == align &&
+            !strcmp(baselines[i].impl, impl) &&
+            !strcmp(baselines[i].value, value))
+            return &baselines[i];
+    return NULL;
+}
+
+static void write_baseline_header(FILE *f) {
+    fprintf(f, "# bench-memcnt baseline, timer: %s\n", TICK_METHOD);
+#ifdef __VERSION__
+    fprintf(f, "# compiler: %s\n", __VERSION__);
+#endif
+    fputs("# impl size align value median_ns ci_lo_ns ci_hi_ns\n", f);
+}
+
+/* =============================
+          memory hierarchy
+   ============================= */
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/* read bandwidth ceilings, like the STREAM kernels but only reading: each
+   reads the whole buffer with the widest loads available and does as little
+   other work as possible (an OR into four independent accumulators). the
+   buffer is aligned and n is a multiple of 64 */
+
+static size_t read_word(const void *s, int c, size_t n) {
+    const size_t *p = (const size_t *)s;
+    size_t a = 0, b = 0, d = 0, e = 0, i, w = n / sizeof(size_t);
+    (void)c;
+    for (i = 0; i + 4 <= w; i += 4) {
+        a |= p[i];
+        b |= p[i + 1];
+        d |= p[i + 2];
+        e |= p[i + 3];
+    }
+    for (; i < w; ++i)
+        a |= p[i];
+    return a | b | d | e;
+}
+
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+static MEMCNT_TARGET("sse2") size_t read_sse2(const void *s, int c, size_t n) {
+    const __m128i *p = (const __m128i *)s;
+    __m128i a = _mm_setzero_si128(), b = a, d = a, e = a;
+    size_t i, w = n / sizeof(__m128i);
+    (void)c;
+    for (i = 0; i + 4 <= w; i += 4) {
+        a = _mm_or_si128(a, _mm_load_si128(p + i));
+        b = _mm_or_si128(b, _mm_load_si128(p + i + 1));
+        d = _mm_or_si128(d, _mm_load_si128(p + i + 2));
+        e = _mm_or_si128(e, _mm_load_si128(p + i + 3));
+    }
+    for (; i < w; ++i)
+        a = _mm_or_si128(a, _mm_load_si128(p + i));
+    a = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(d, e));
+    return (size_t)(unsigned)_mm_cvtsi128_si32(a);
+}
+#endif
+
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+static MEMCNT_TARGET("avx2") size_t read_avx2(const void *s, int c, size_t n) {
+    const __m256i *p = (const __m256i *)s;
+    __m256i a = _mm256_setzero_si256(), b = a, d = a, e = a;
+    size_t i, w = n / sizeof(__m256i);
+    (void)c;
+    for (i = 0; i + 4 <= w; i += 4) {
+        a = _mm256_or_si256(a, _mm256_load_si256(p + i));
+        b = _mm256_or_si256(b, _mm256_load_si256(p + i + 1));
+        d = _mm256_or_si256(d, _mm256_load_si256(p + i + 2));
+        e = _mm256_or_si256(e, _mm256_load_si256(p + i + 3));
+    }
+    for (; i < w; ++i)
+        a = _mm256_or_si256(a, _mm256_load_si256(p + i));
+    a = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(d, e));
+    return (size_t)(unsigned)_mm_cvtsi128_si32(_mm256_castsi256_si128(a));
+}
+#endif
+
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+static MEMCNT_TARGET("avx512f") size_t read_avx512(const void *s, int c,
+                                                   size_t n) {
+    const __m512i *p = (const __m512i *)s;
+    __m512i a = _mm512_setzero_si512(), b = a, d = a, e = a;
+    size_t i, w = n / sizeof(__m512i);
+    (void)c;
+    for (i = 0; i + 4 <= w; i += 4) {
+        a = _mm512_or_si512(a, _mm512_load_si512(p + i));
+        b = _mm512_or_si512(b, _mm512_load_si512(p + i + 1));
+        d = _mm512_or_si512(d, _mm512_load_si512(p + i + 2));
+        e = _mm512_or_si512(e, _mm512_load_si512(p + i + 3));
+    }
+    for (; i < w; ++i)
+        a = _mm512_or_si512(a, _mm512_load_si512(p + i));
+    a = _mm512_or_si512(_mm512_or_si512(a, b), _mm512_or_si512(d, e));
+    return (size_t)(unsigned)_mm512_reduce_or_epi32(a);
+}
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(MEMCNT_DCHECK_neon)
+static size_t read_neon(const void *s, int c, size_t n) {
+    const uint8_t *p = (const uint8_t *)s;
+    uint8x16_t a = vdupq_n_u8(0), b = a, d = a, e = a;
+    size_t i;
+    (void)c;
+    for (i = 0; i + 64 <= n; i += 64) {
+        a = vorrq_u8(a, vld1q_u8(p + i));
+        b = vorrq_u8(b, vld1q_u8(p + i + 16));
+        d = vorrq_u8(d, vld1q_u8(p + i + 32));
+        e = vorrq_u8(e, vld1q_u8(p + i + 48));
+    }
+    a = vorrq_u8(vorrq_u8(a, b), vorrq_u8(d, e));
+    return vgetq_lane_u32(vreinterpretq_u32_u8(a), 0);
+}
+#endif
+
+static struct bench_impl ceilings[5];
+static int ceiling_count = 0;
+
+static void add_ceiling(const char *name, bench_fn_t fn, int supported) {
+    if (supported) {
+        ceilings[ceiling_count].name = name;
+        ceilings[ceiling_count].fn = fn;
+        ++ceiling_count;
+    }
+}
+
+#define BENCH_CEILING(x) add_ceiling("read:" #x, &read_##x, MEMCNT_DCHECK_##x)
+
+static void find_ceilings(void) {
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+    BENCH_CEILING(avx512);
+#endif
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+    BENCH_CEILING(avx2);
+#endif
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+    BENCH_CEILING(sse2);
+#endif
+#if MEMCNT_COMPILED_neon && defined(MEMCNT_DCHECK_neon)
+    BENCH_CEILING(neon);
+#endif
+    add_ceiling("read:word", &read_word, 1);
+}
+
+/* cache sizes in bytes, 0 if unknown */
+static size_t cache_l1d, cache_l2, cache_llc;
+
+static void find_cache_sizes(void) {
+#if defined(__linux__)
+    int i;
+    for (i = 0; i < 16; ++i) {
+        char path[96], type[32] = "", unit = 0;
+        int level = 0;
+        unsigned long size = 0;
+        FILE *f;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (!(f = fopen(path, "r")))
+            break;
+        if (fscanf(f, "%d", &level) != 1)
+            level = 0;
+        fclose(f);
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        if ((f = fopen(path, "r"))) {
+            if (fscanf(f, "%31s", type) != 1)
+                type[0] = 0;
+            fclose(f);
+        }
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if ((f = fopen(path, "r"))) {
+            if (fscanf(f, "%lu%c", &size, &unit) < 1)
+                size = 0;
+            fclose(f);
+        }
+        size *= unit == 'K' ? 1024UL : unit == 'M' ? 1024UL * 1024 : 1;
+        if (!strcmp(type, "Instruction"))
+            continue;
+        if (level == 1)
+            cache_l1d = size;
+        else if (level == 2)
+            cache_l2 = size;
+        if (level >= 2 && size > cache_llc)
+            cache_llc = size;
+    }
+#endif
+}
+
+static const char *hierarchy_level(size_t n) {
+    return n <= cache_l1d ? "L1" : n <= cache_l2 ? "L2" : n <= cache_llc ? "LLC"
+                                                                          : "DRAM";
+}
+
+/* working sets well inside each level (and well outside the last one) */
+static int hierarchy_sizes(size_t *out) {
+    size_t l1 = cache_l1d ? cache_l1d : 32768, l2 = cache_l2 ? cache_l2 : l1 * 8,
+           llc = cache_llc ? cache_llc : l2 * 8, dram = llc * 4;
+    if (!cache_l1d)
+        cache_l1d = l1;
+    if (!cache_l2)
+        cache_l2 = l2;
+    if (!cache_llc)
+        cache_llc = llc;
+    if (dram < ((size_t)64 << 20))
+        dram = (size_t)64 << 20;
+    out[0] = (l1 / 2) & ~(size_t)63;
+    out[1] = (l2 / 2) & ~(size_t)63;
+    out[2] = (llc / 2) & ~(size_t)63;
+    out[3] = dram;
+    return out[1] > out[0] && out[2] > out[1] ? 4 : 1;
+}
+
+/* =============================
+         buffer placement
+   ============================= */
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define BENCH_MPOL_BIND 2
+#define BENCH_MPOL_F_NODE 1
+#define BENCH_MPOL_F_ADDR 2
+
+static const char *page_info = "default";
+
+/* returns the NUMA node of the CPU this thread runs on, or -1 */
+static int current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if (!syscall(SYS_getcpu, &cpu, &node, NULL))
+        return (int)node;
+#endif
+    return -1;
+}
+
+/* returns some NUMA node other than the given one, or -1 */
+static int other_node(int node) {
+#if defined(__linux__)
+    char line[256];
+    const char *s = line;
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if (!f)
+        return -1;
+    if (!fgets(line, sizeof(line), f))
+        line[0] = 0;
+    fclose(f);
+    /* a list such as 0-3,5 */
+    while (*s) {
+        char *e;
+        long lo = strtol(s, &e, 10), hi = lo;
+        if (e == s)
+            break;
+        if (*e == '-')
+            hi = strtol(e + 1, &e, 10);
+        for (; lo <= hi; ++lo)
+            if (lo != node)
+                return (int)lo;
+        if (*e != ',')
+            break;
+        s = e + 1;
+    }
+#else
+    (void)node;
+#endif
+    return -1;
+}
+
+/* returns the NUMA node the page at p is on, or -1 */
+static int page_node(void *p) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    int node = -1;
+    if (!syscall(SYS_get_mempolicy, &node, NULL, 0UL, p,
+                 BENCH_MPOL_F_NODE | BENCH_MPOL_F_ADDR))
+        return node;
+#else
+    (void)p;
+#endif
+    return -1;
+}
+
+/* binds the n bytes at p (page aligned) to a NUMA node. returns 0 if OK */
+static int bind_pages(void *p, size_t n, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask[16] = {0};
+    const int bits = CHAR_BIT * sizeof(unsigned long);
+    if (node < 0 || node >= 16 * bits)
+        return -1;
+    mask[node / bits] |= 1UL << (node % bits);
+    return syscall(SYS_mbind, p, n, BENCH_MPOL_BIND, mask,
+                   (unsigned long)(16 * bits), 0)
+               ? -1
+               : 0;
+#else
+    (void)p, (void)n, (void)node;
+    return -1;
+#endif
+}
+
+/* stores the NUMA node of each of count pages into nodes (-1 if not known),
+   asking for all of them at once with move_pages if possible */
+static void pages_nodes(void **pages, int *nodes, size_t count) {
+    size_t i;
+#if defined(__linux__) && defined(SYS_move_pages)
+    /* with no target nodes, move_pages only tells where the pages are */
+    if (!syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, nodes,
+                 0)) {
+        for (i = 0; i < count; ++i)
+            if (nodes[i] < 0)
+                nodes[i] = -1;
+        return;
+    }
+#endif
+    for (i = 0; i < count; ++i)
+        nodes[i] = page_node(pages[i]);
+}
+
+/* allocates n bytes aligned to a page, optionally on huge pages and bound to
+   a NUMA node (node < 0 for no binding). the memory is not touched, so that
+   the binding applies when it is first written */
+static void *alloc_pages(size_t n, int huge, int node) {
+#if defined(__linux__)
+    void *p = MAP_FAILED;
+    if (huge)
+        n = (n + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+    if (huge) {
+        p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            page_info = "huge (hugetlbfs)";
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        page_info = "small";
+#ifdef MADV_HUGEPAGE
+        /* no reserved huge pages, try transparent huge pages instead */
+        if (huge && !madvise(p, n, MADV_HUGEPAGE))
+            page_info = "huge (transparent, if available)";
+#endif
+        if (huge && !strcmp(page_info, "small"))
+            fputs("warning: could not get huge pages\n", stderr);
+    }
+    if (node >= 0 && bind_pages(p, n, node))
+        fprintf(stderr, "warning: could not bind memory to node %d\n", node);
+    return p;
+#else
+    if (huge || node >= 0)
+        fputs("warning: page size and NUMA placement are only supported on "
+              "Linux\n",
+              stderr);
+    return malloc(n);
+#endif
+}
+
+static void free_pages(void *p, size_t n, int huge) {
+#if defined(__linux__)
+    if (huge)
+        n = (n + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    munmap(p, n);
+#else
+    (void)n, (void)huge;
+    free(p);
+#endif
+}
+
+/* =============================
+              threads
+   ============================= */
+
+#if IS_WINDOWS
+#define CAN_THREAD 1
+#elif IS_POSIX
+#include <pthread.h>
+#define CAN_THREAD 1
+#else
+#define CAN_THREAD 0
+#endif
+
+#define MAX_THREADS 256
+#define MAX_NODES 64
+/* the capacity of the fastest cores (as in cpu_capacity on Linux) */
+#define FULL_CAPACITY 1024
+/* each thread count is timed over about this long */
+#define THREAD_RUN_SECONDS 0.05
+
+struct bench_cpu {
+    /* node is the NUMA node and capacity the speed relative to the fastest
+       cores, FULL_CAPACITY for those */
+    int cpu, package, core, sibling, node, capacity;
+};
+static struct bench_cpu cpus[MAX_THREADS];
+static int cpu_count, has_smt;
+
+#if defined(__linux__)
+static int read_int_file(const char *path) {
+    int v = -1;
+    FILE *f;
+    if ((f = fopen(path, "r"))) {
+        if (fscanf(f, "%d", &v) != 1)
+            v = -1;
+        fclose(f);
+    }
+    return v;
+}
+
+static int read_topology(int cpu, const char *name) {
+    char path[96];
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    return read_int_file(path);
+}
+
+/* the NUMA node of a CPU, from the nodeN link in its sysfs directory */
+static int read_cpu_node(int cpu) {
+    char path[96];
+    int node;
+    for (node = 0; node < MAX_NODES; ++node) {
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (!access(path, F_OK))
+            return node;
+    }
+    return 0;
+}
+
+/* whether a list of CPUs in a file (such as 0-3,8) contains cpu */
+static int in_cpu_list(const char *path, int cpu) {
+    char line[1024];
+    const char *s = line;
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    if (!fgets(line, sizeof(line), f))
+        line[0] = 0;
+    fclose(f);
+    while (*s) {
+        char *e;
+        long lo = strtol(s, &e, 10), hi = lo;
+        if (e == s)
+            break;
+        if (*e == '-')
+            hi = strtol(e + 1, &e, 10);
+        if (lo <= cpu && cpu <= hi)
+            return 1;
+        if (*e != ',')
+            break;
+        s = e + 1;
+    }
+    return 0;
+}
+
+/* cpu_capacity is there on ARM (big.LITTLE) and on hybrid x86 with recent
+   kernels. otherwise, the E-cores of hybrid Intel CPUs (the ones in
+   cpu_atom) are taken to be about half as fast as the P-cores */
+static int read_capacity(int cpu) {
+    char path[96];
+    int v;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+    if ((v = read_int_file(path)) > 0)
+        return v < FULL_CAPACITY ? v : FULL_CAPACITY;
+    return in_cpu_list("/sys/devices/cpu_atom/cpus", cpu) ? FULL_CAPACITY / 2
+                                                          : FULL_CAPACITY;
+}
+#endif
+
+/* finds the CPUs this process may run on, with their cores and packages.
+   must be called before pinning */
+static void find_topology(void) {
+    int i, j;
+#if defined(__linux__)
+    cpu_set_t set;
+    if (!sched_getaffinity(0, sizeof(set), &set)) {
+        for (i = 0; i < CPU_SETSIZE && cpu_count < MAX_THREADS; ++i) {
+            if (!CPU_ISSET(i, &set))
+                continue;
+            cpus[cpu_count].cpu = i;
+            cpus[cpu_count].package = read_topology(i, "physical_package_id");
+            cpus[cpu_count].core = read_topology(i, "core_id");
+            if (cpus[cpu_count].core < 0)
+                cpus[cpu_count].core = i;
+            cpus[cpu_count].node = read_cpu_node(i);
+            cpus[cpu_count].capacity = read_capacity(i);
+            ++cpu_count;
+        }
+    }
+#endif
+    if (!cpu_count) {
+        /* no topology, assume every CPU is its own core */
+#if IS_WINDOWS
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cpu_count = (int)si.dwNumberOfProcessors;
+#elif IS_POSIX && defined(_SC_NPROCESSORS_ONLN)
+        cpu_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (cpu_count < 1)
+            cpu_count = 1;
+        if (cpu_count > MAX_THREADS)
+            cpu_count = MAX_THREADS;
+        for (i = 0; i < cpu_count; ++i) {
+            cpus[i].cpu = cpus[i].core = i;
+            cpus[i].package = cpus[i].node = 0;
+            cpus[i].capacity = FULL_CAPACITY;
+        }
+    }
+    for (i = 0; i < cpu_count; ++i) {
+        cpus[i].sibling = 0;
+        for (j = 0; j < i; ++j)
+            if (cpus[j].package == cpus[i].package &&
+                cpus[j].core == cpus[i].core)
+                ++cpus[i].sibling;
+        if (cpus[i].sibling)
+            has_smt = 1;
+    }
+}
+
+/* spread: one thread on every core before any core gets a second one */
+static int compare_cpu_spread(const void *a, const void *b) {
+    const struct bench_cpu *x = (const struct bench_cpu *)a,
+                           *y = (const struct bench_cpu *)b;
+    if (x->sibling != y->sibling)
+        return x->sibling - y->sibling;
+    if (x->package != y->package)
+        return x->package - y->package;
+    return x->core != y->core ? x->core - y->core : x->cpu - y->cpu;
+}
+
+/* packed: SMT siblings of a core next to each other */
+static int compare_cpu_packed(const void *a, const void *b) {
+    const struct bench_cpu *x = (const struct bench_cpu *)a,
+                           *y = (const struct bench_cpu *)b;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->sibling != y->sibling ? x->sibling - y->sibling
+                                    : x->cpu - y->cpu;
+}
+
+struct bench_parallel;
+
+struct bench_worker {
+    bench_fn_t fn;
+    const unsigned char *src; /* copied into buf if they differ */
+    unsigned char *buf;
+    size_t n, result;
+    int value, cpu;
+    unsigned long iters;
+    double start, seconds;
+    /* for -m parallel: the buffer shared by the workers (NULL otherwise), the
+       node and capacity of the CPU, and how many bytes it read on its node */
+    struct bench_parallel *par;
+    int node, capacity;
+    size_t local;
+};
+
+#if CAN_THREAD
+/* every worker waits at the gate until all of them are ready */
+static int gate_ready, gate_open;
+#if IS_WINDOWS
+static CRITICAL_SECTION gate_lock;
+static CONDITION_VARIABLE gate_cond;
+#define GATE_INIT()                                                            \
+    (InitializeCriticalSection(&gate_lock),                                    \
+     InitializeConditionVariable(&gate_cond))
+#define GATE_LOCK() EnterCriticalSection(&gate_lock)
+#define GATE_UNLOCK() LeaveCriticalSection(&gate_lock)
+#define GATE_WAIT() SleepConditionVariableCS(&gate_cond, &gate_lock, INFINITE)
+#define GATE_SIGNAL() WakeAllConditionVariable(&gate_cond)
+#else
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+#define GATE_INIT()
+#define GATE_LOCK() pthread_mutex_lock(&gate_lock)
+#define GATE_UNLOCK() pthread_mutex_unlock(&gate_lock)
+#define GATE_WAIT() pthread_cond_wait(&gate_cond, &gate_lock)
+#define GATE_SIGNAL() pthread_cond_broadcast(&gate_cond)
+#endif
+
+/* the buffer of -m parallel is split into segments, each of which is on one
+   NUMA node, and the segments on each node are queued for the threads on
+   that node. chunks are taken from the queues under the gate lock */
+#define PARALLEL_SEGMENT ((size_t)2 << 20)
+#define PARALLEL_MIN_CHUNK ((size_t)256 << 10)
+
+struct bench_queue {
+    /* the segments, the next one and how far into it, and the bytes left */
+    size_t *segs, count, pos, off, left;
+    /* the threads on this node */
+    int workers;
+};
+
+struct bench_parallel {
+    const unsigned char *buf;
+    size_t n, seg_count;
+    int *seg_node; /* the node of each segment */
+    int even;      /* split evenly among the threads instead of queued */
+    struct bench_queue q[MAX_NODES];
+};
+
+/* takes the next chunk for w from the queue of its node, or from the queue
+   with the most left if that is empty. the size of the chunk is a share of
+   what is left on the node, scaled by the capacity of the core, so that the
+   chunks get smaller towards the end and the slower cores take smaller ones.
+   returns the size (0 if done) and stores the offset into *at */
+static size_t parallel_take(struct bench_worker *w, size_t *at) {
+    struct bench_parallel *p = w->par;
+    struct bench_queue *q = &p->q[w->node];
+    size_t want, len = 0, seg, seg_len;
+    int i;
+    GATE_LOCK();
+    if (!q->left)
+        for (i = 0; i < MAX_NODES; ++i)
+            if (p->q[i].left > q->left)
+                q = &p->q[i];
+    want = q->left / (2 * (q->workers ? q->workers : 1)) / FULL_CAPACITY *
+           w->capacity;
+    if (want < PARALLEL_MIN_CHUNK)
+        want = PARALLEL_MIN_CHUNK;
+    /* across segments only as long as they are next to each other */
+    while (q->pos < q->count && len < want) {
+        seg = q->segs[q->pos];
+        if (len && seg * PARALLEL_SEGMENT + q->off != *at + len)
+            break;
+        if (!len)
+            *at = seg * PARALLEL_SEGMENT + q->off;
+        seg_len = p->n - seg * PARALLEL_SEGMENT;
+        if (seg_len > PARALLEL_SEGMENT)
+            seg_len = PARALLEL_SEGMENT;
+        if (seg_len - q->off > want - len) {
+            q->off += want - len;
+            len = want;
+        } else {
+            len += seg_len - q->off;
+            q->off = 0;
+            ++q->pos;
+        }
+    }
+    q->left -= len;
+    if (q == &p->q[w->node])
+        w->local += len;
+    GATE_UNLOCK();
+    return len;
+}
+
+static void run_worker(struct bench_worker *w) {
+    unsigned long i;
+    size_t s = 0, at, len;
+    double t0;
+    pin_cpu(w->cpu);
+    /* written by the thread itself, so that the memory is placed on the
+       NUMA node of the thread (unless bound with -n) */
+    if (w->buf != w->src)
+        memcpy(w->buf, w->src, w->n);
+    if (!w->par)
+        s = w->fn(w->buf, w->value, w->n);
+    GATE_LOCK();
+    ++gate_ready;
+    GATE_SIGNAL();
+    while (!gate_open)
+        GATE_WAIT();
+    GATE_UNLOCK();
+    w->start = t0 = getseconds();
+    if (!w->par || w->par->even) {
+        for (i = 0; i < w->iters; ++i)
+            s += w->fn(w->buf, w->value, w->n);
+    } else {
+        while ((len = parallel_take(w, &at)))
+            s += w->fn(w->par->buf + at, w->value, len);
+    }
+    w->seconds = getseconds() - t0;
+    w->result = s;
+}
+
+#if IS_WINDOWS
+static DWORD WINAPI worker_main(LPVOID arg) {
+    run_worker((struct bench_worker *)arg);
+    return 0;
+}
+#else
+static void *worker_main(void *arg) {
+    run_worker((struct bench_worker *)arg);
+    return NULL;
+}
+#endif
+
+/* runs count workers at once. returns 0 if a thread could not be started */
+static int run_workers(struct bench_worker *w, int count) {
+#if IS_WINDOWS
+    HANDLE threads[MAX_THREADS];
+#else
+    pthread_t threads[MAX_THREADS];
+#endif
+    int i, started;
+    static int gate_init = 0;
+    if (!gate_init) {
+        GATE_INIT();
+        gate_init = 1;
+    }
+    gate_ready = gate_open = 0;
+    for (started = 0; started < count; ++started) {
+#if IS_WINDOWS
+        threads[started] = CreateThread(NULL, 0, worker_main, &w[started], 0,
+                                        NULL);
+        if (!threads[started])
+            break;
+#else
+        if (pthread_create(&threads[started], NULL, worker_main, &w[started]))
+            break;
+#endif
+    }
+    GATE_LOCK();
+    while (gate_ready < started)
+        GATE_WAIT();
+    gate_open = 1;
+    GATE_SIGNAL();
+    GATE_UNLOCK();
+    for (i = 0; i < started; ++i) {
+#if IS_WINDOWS
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+        sink += w[i].result;
+    }
+    return started == count;
+}
+#endif
+
+/* =============================
+              options
+   ============================= */
+
+static int parse_list(const char *s, size_t *out, int max) {
+    int n = 0;
+    while (*s) {
+        char *e;
+        size_t lo = (size_t)strtoul(s, &e, 0), hi = lo;
+        if (e == s)
+            return -1;
+        if (*e == '-') {
+            s = e + 1;
+            hi = (size_t)strtoul(s, &e, 0);
+            if (e == s || hi < lo)
+                return -1;
+        }
+        for (; lo <= hi; ++lo) {
+            if (n >= max)
+                return -1;
+            out[n++] = lo;
+        }
+        s = *e == ',' ? e + 1 : e;
+    }
+    return n;
+}
+
+static int fill_range(size_t *out, size_t lo, size_t hi) {
+    int n = 0;
+    for (; lo <= hi; ++lo)
+        out[n++] = lo;
+    return n;
+}
+
+static int in_name_list(const char *list, const char *name) {
+    size_t len = strlen(name);
+    while (list && *list) {
+        const char *e = strchr(list, ',');
+        size_t l = e ? (size_t)(e - list) : strlen(list);
+        if (l == len && !memcmp(list, name, l))
+            return 1;
+        list = e ? e + 1 : NULL;
+    }
+    return 0;
+}
+
+enum bench_format { FORMAT_TABLE, FORMAT_CSV, FORMAT_JSON };
+enum bench_mode {
+    MODE_THROUGHPUT,
+    MODE_LATENCY,
+    MODE_COUNTERS,
+    MODE_HIERARCHY,
+    MODE_THREADS,
+    MODE_PARALLEL,
+    MODE_STDIN
+};
+static const char *mode_names[] = {"throughput", "latency",  "counters",
+                                   "hierarchy",  "threads",  "parallel",
+                                   "stdin"};
+
+static void usage(void) {
+    puts("usage: bench-memcnt [-m throughput|latency|counters|hierarchy|"
+         "threads|parallel|"
+         "\n                    stdin]"
+         "\n                    [-f table|csv|json] [-i impl,...]"
+         "\n                    [-s size,...] [-a align,...]"
+         "\n                    [-v none,sparse,all] [-r repeats]"
+         "\n                    [-w warmups] [-c cpu] [-e name=config,...]"
+         "\n                    [-o baseline] [-b baseline] [-t percent]"
+         "\n                    [-p small|huge] [-n local|remote|node]"
+         "\n                    [-T threads,...] [-I read|ring]");
+}
+
+/* =============================
+               modes
+   ============================= */
+
+static size_t sizes[MAX_LIST], aligns[MAX_LIST], thread_counts[MAX_LIST];
+static int size_count, align_count, thread_count_count;
+static int values[VALUE_COUNT], value_count;
+static int repeats, warmups, format = FORMAT_TABLE;
+static unsigned char *buf_random, *buf_same;
+static double *samples, ticks_per_second;
+static int first_row = 1;
+static FILE *record_file;
+static double tolerance = 5; /* percent */
+
+/* checks the result of an implementation against memcnt_default */
+static int check_impl(const struct bench_impl *impl, const unsigned char *p,
+                      int value, size_t n) {
+    if (impl->fn(p, value, n) != MEMCNT_NAME(default)(p, value, n)) {
+        fprintf(stderr,
+                "memcnt_%s returned a wrong result for size=%zu "
+                "align=%u value=%d\n",
+                impl->name, n, (unsigned)((uintptr_t)p & 63), value);
+        return 0;
+    }
+    return 1;
+}
+
+static void json_begin_row(void) {
+    printf("%s\n    {", first_row ? "" : ",");
+    first_row = 0;
+}
+
+/* writes a measurement into the baseline file given with -o. v must be
+   sorted and in nanoseconds */
+static void record_row(const char *impl, size_t n, size_t align, int vi,
+                       const double *v, int count) {
+    double lo, hi;
+    if (!record_file)
+        return;
+    median_ci(v, count, &lo, &hi);
+    fprintf(record_file, "%s %zu %zu %s %.3f %.3f %.3f\n", impl, n, align,
+            value_names[vi], percentile(v, count, 50), lo, hi);
+}
+
+static int run_throughput(void) {
+    int i, si, ai, k, j;
+    if (format == FORMAT_TABLE)
+        printf("%-10s %10s %5s %6s | %10s %10s | %8s %8s | %8s\n", "impl",
+               "size", "align", "value", "med tick", "p99 tick", "med B/t",
+               "p99 B/t", "med GB/s");
+    else if (format == FORMAT_CSV)
+        puts("impl,size,align,value,median_ticks,p99_ticks,median_bpt,"
+             "p99_bpt,median_gbps");
+
+    for (i = 0; i < impl_count; ++i) {
+        for (si = 0; si < size_count; ++si) {
+            for (ai = 0; ai < align_count; ++ai) {
+                for (k = 0; k < value_count; ++k) {
+                    size_t n = sizes[si];
+                    int vi = values[k], value;
+                    const unsigned char *p;
+                    struct bench_result r;
+                    double bpt_med, bpt_p99, gbps;
+                    p = (vi == VALUE_ALL ? buf_same : buf_random) + aligns[ai];
+                    value = vi == VALUE_NONE ? 255 : vi == VALUE_ALL ? 'A' : 'x';
+                    if (!check_impl(&impls[i], p, value, n))
+                        return 1;
+
+                    r = measure(impls[i].fn, p, value, n, warmups, repeats,
+                                samples);
+                    if (record_file) {
+                        for (j = 0; j < repeats; ++j)
+                            samples[j] *= 1e9 / ticks_per_second;
+                        record_row(impls[i].name, n, aligns[ai], vi, samples,
+                                   repeats);
+                    }
+                    bpt_med = r.median > 0 ? n / r.median : 0;
+                    bpt_p99 = r.p99 > 0 ? n / r.p99 : 0;
+                    gbps = bpt_med * ticks_per_second / 1e9;
+
+                    if (format == FORMAT_TABLE) {
+                        printf("%-10s %10zu %5zu %6s | %10.1f %10.1f | "
+                               "%8.3f %8.3f | %8.2f\n",
+                               impls[i].name, n, aligns[ai], value_names[vi],
+                               r.median, r.p99, bpt_med, bpt_p99, gbps);
+                    } else if (format == FORMAT_CSV) {
+                        printf("%s,%zu,%zu,%s,%.2f,%.2f,%.4f,%.4f,%.3f\n",
+                               impls[i].name, n, aligns[ai], value_names[vi],
+                               r.median, r.p99, bpt_med, bpt_p99, gbps);
+                    } else {
+                        json_begin_row();
+                        printf("\"impl\": \"%s\", \"size\": %zu, "
+                               "\"align\": %zu, \"value\": \"%s\", "
+                               "\"median_ticks\": %.2f, \"p99_ticks\": %.2f, "
+                               "\"median_bpt\": %.4f, \"p99_bpt\": %.4f, "
+                               "\"median_gbps\": %.3f}",
+                               impls[i].name, n, aligns[ai], value_names[vi],
+                               r.median, r.p99, bpt_med, bpt_p99, gbps);
+                    }
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+enum bench_verdict { SAME, SLOWER, FASTER, NOISY, NEW };
+static const char *verdict_names[] = {"same", "slower", "faster", "noisy",
+                                      "new"};
+
+struct bench_sample {
+    double median, lo, hi; /* nanoseconds per call */
+    int count;
+};
+
+/* measures one combination against its baseline b (may be NULL). while the
+   medians differ by more than the tolerance but the confidence intervals
+   still overlap, more samples are taken (up to MAX_RESAMPLE times the
+   requested number); a difference is only significant once the intervals
+   separate */
+static int compare_row(bench_fn_t fn, const unsigned char *p, int value,
+                       size_t n, const struct bench_baseline *b,
+                       struct bench_sample *s) {
+    double to_ns = 1e9 / ticks_per_second, change;
+    unsigned long iters = batch_iters(fn, p, value, n);
+    int j;
+    for (j = 0; j < warmups; ++j)
+        time_batch(fn, p, value, n, iters);
+    s->count = 0;
+    for (;;) {
+        for (j = 0; j < repeats; ++j)
+            samples[s->count++] =
+                time_batch(fn, p, value, n, iters) * to_ns / iters;
+        qsort(samples, s->count, sizeof(double), compare_double);
+        s->median = percentile(samples, s->count, 50);
+        median_ci(samples, s->count, &s->lo, &s->hi);
+        if (!b || s->lo > b->hi || s->hi < b->lo ||
+            s->count >= repeats * MAX_RESAMPLE)
+            break;
+        if (s->median <= b->median * (1 + tolerance / 100) &&
+            s->median >= b->median * (1 - tolerance / 100))
+            break;
+    }
+    if (!b)
+        return NEW;
+    change = b->median > 0 ? (s->median / b->median - 1) * 100 : 0;
+    if (change > tolerance)
+        return s->lo > b->hi ? SLOWER : NOISY;
+    if (change < -tolerance)
+        return s->hi < b->lo ? FASTER : NOISY;
+    return SAME;
+}
+
+/* compares against the baseline given with -b. a slowdown is measured again
+   from scratch to confirm it, since the confidence intervals only cover the
+   noise within one measurement. returns 3 if anything got significantly
+   slower */
+static int run_compare(void) {
+    int i, si, ai, k, result = 0;
+    if (format == FORMAT_TABLE)
+        printf("%-10s %10s %5s %6s | %10s %10s %10s %10s | %7s %5s %s\n",
+               "impl", "size", "align", "value", "base ns", "med ns",
+               "ci lo ns", "ci hi ns", "change", "n", "verdict");
+    else if (format == FORMAT_CSV)
+        puts("impl,size,align,value,baseline_ns,median_ns,ci_lo_ns,ci_hi_ns,"
+             "change_pct,samples,verdict");
+
+    for (i = 0; i < impl_count; ++i) {
+        for (si = 0; si < size_count; ++si) {
+            for (ai = 0; ai < align_count; ++ai) {
+                for (k = 0; k < value_count; ++k) {
+                    size_t n = sizes[si];
+                    int vi = values[k], value, verdict;
+                    const unsigned char *p;
+                    const struct bench_baseline *b;
+                    struct bench_sample s;
+                    double base = -1, change = 0;
+                    p = (vi == VALUE_ALL ? buf_same : buf_random) + aligns[ai];
+                    value = vi == VALUE_NONE ? 255 : vi == VALUE_ALL ? 'A' : 'x';
+                    if (!check_impl(&impls[i], p, value, n))
+                        return 1;
+                    b = find_baseline(impls[i].name, n, aligns[ai],
+                                      value_names[vi]);
+
+                    verdict = compare_row(impls[i].fn, p, value, n, b, &s);
+                    if (verdict == SLOWER)
+                        verdict = compare_row(impls[i].fn, p, value, n, b, &s);
+                    if (verdict == SLOWER)
+                        result = 3;
+                    record_row(impls[i].name, n, aligns[ai], vi, samples,
+                               s.count);
+                    if (b) {
+                        base = b->median;
+                        change = base > 0 ? (s.median / base - 1) * 100 : 0;
+                    }
+
+                    if (format == FORMAT_TABLE) {
+                        printf("%-10s %10zu %5zu %6s | ", impls[i].name, n,
+                               aligns[ai], value_names[vi]);
+                        b ? printf("%10.2f", base) : printf("%10s", "-");
+                        printf(" %10.2f %10.2f %10.2f | ", s.median, s.lo,
+                               s.hi);
+                        b ? printf("%+6.1f%%", change) : printf("%7s", "-");
+                        printf(" %5d %s\n", s.count, verdict_names[verdict]);
+                    } else if (format == FORMAT_CSV) {
+                        printf("%s,%zu,%zu,%s,", impls[i].name, n, aligns[ai],
+                               value_names[vi]);
+                        if (b)
+                            printf("%.3f", base);
+                        printf(",%.3f,%.3f,%.3f,", s.median, s.lo, s.hi);
+                        if (b)
+                            printf("%.2f", change);
+                        printf(",%d,%s\n", s.count, verdict_names[verdict]);
+                    } else {
+                        json_begin_row();
+                        printf("\"impl\": \"%s\", \"size\": %zu, "
+                               "\"align\": %zu, \"value\": \"%s\", "
+                               "\"baseline_ns\": ",
+                               impls[i].name, n, aligns[ai], value_names[vi]);
+                        b ? printf("%.3f", base) : printf("null");
+                        printf(", \"median_ns\": %.3f, \"ci_lo_ns\": %.3f, "
+                               "\"ci_hi_ns\": %.3f, \"change_pct\": ",
+                               s.median, s.lo, s.hi);
+                        b ? printf("%.2f", change) : printf("null");
+                        printf(", \"samples\": %d, \"verdict\": \"%s\"}",
+                               s.count, verdict_names[verdict]);
+                    }
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/* the table only shows the mean and worst case over the alignments for each
+   size; use csv or json for every alignment separately */
+static int run_latency(void) {
+    int i, si, ai;
+    double overhead = measure_timer_overhead(samples, repeats);
+    if (format == FORMAT_TABLE) {
+        printf("timer overhead: %.1f ticks%s\n", overhead,
+               CAN_FLUSH ? "" : ", cold measurements not supported");
+        printf("%-10s %6s | %10s %10s | %10s %10s\n", "impl", "size",
+               "warm mean", "warm max", "cold mean", "cold max");
+    } else if (format == FORMAT_CSV) {
+        puts("impl,size,align,warm_ticks,cold_ticks");
+    }
+
+    for (i = 0; i < impl_count; ++i) {
+        for (si = 0; si < size_count; ++si) {
+            size_t n = sizes[si];
+            double warm_sum = 0, warm_max = 0, cold_sum = 0, cold_max = 0;
+            for (ai = 0; ai < align_count; ++ai) {
+                const unsigned char *p = buf_random + aligns[ai];
+                double warm, cold = -1;
+                if (!check_impl(&impls[i], p, 'x', n))
+                    return 1;
+                warm = measure_latency_warm(impls[i].fn, p, 'x', n, warmups,
+                                            repeats, samples);
+                if (CAN_FLUSH)
+                    cold = measure_latency_cold(impls[i].fn, p, 'x', n,
+                                                repeats, overhead, samples);
+                warm_sum += warm;
+                cold_sum += cold;
+                if (warm > warm_max)
+                    warm_max = warm;
+                if (cold > cold_max)
+                    cold_max = cold;
+
+                if (format == FORMAT_CSV) {
+                    printf("%s,%zu,%zu,%.2f,%.2f\n", impls[i].name, n,
+                           aligns[ai], warm, cold);
+                } else if (format == FORMAT_JSON) {
+                    json_begin_row();
+                    printf("\"impl\": \"%s\", \"size\": %zu, \"align\": %zu, "
+                           "\"warm_ticks\": %.2f, \"cold_ticks\": %.2f}",
+                           impls[i].name, n, aligns[ai], warm, cold);
+                }
+            }
+            if (format == FORMAT_TABLE)
+                printf("%-10s %6zu | %10.1f %10.1f | %10.1f %10.1f\n",
+                       impls[i].name, n, warm_sum / align_count, warm_max,
+                       cold_sum / align_count, cold_max);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
+
+/* prints a count, or a placeholder if it is not available (negative) */
+static void print_count(double v, const char *sep) {
+    if (format == FORMAT_TABLE)
+        v < 0 ? printf("%s%10s", sep, "-") : printf("%s%10.2f", sep, v);
+    else if (format == FORMAT_CSV)
+        v < 0 ? printf("%s", sep) : printf("%s%.3f", sep, v);
+    else
+        v < 0 ? printf("%snull", sep) : printf("%s%.3f", sep, v);
+}
+
+static double ratio(double a, double b) { return a < 0 || b <= 0 ? -1 : a / b; }
+
+/* counts are per call; bytes per miss is not available if nothing missed */
+static int run_counters(void) {
+    static const char *derived[] = {"ipc", "b/l1d-miss", "b/llc-miss"};
+    double counts[MAX_COUNTERS + 3];
+    int i, si, ai, k;
+    if (format == FORMAT_TABLE) {
+        printf("%-10s %10s %5s %6s |", "impl", "size", "align", "value");
+        for (k = 0; k < counter_count; ++k)
+            printf(" %10.10s", counters[k].name);
+        printf(" | %10s %10s %10s\n", derived[0], derived[1], derived[2]);
+    } else if (format == FORMAT_CSV) {
+        printf("impl,size,align,value");
+        for (k = 0; k < counter_count; ++k)
+            printf(",%s", counters[k].name);
+        printf(",%s,%s,%s\n", derived[0], derived[1], derived[2]);
+    }
+
+    for (i = 0; i < impl_count; ++i) {
+        for (si = 0; si < size_count; ++si) {
+            for (ai = 0; ai < align_count; ++ai) {
+                for (k = 0; k < value_count; ++k) {
+                    size_t n = sizes[si];
+                    int vi = values[k], value, j;
+                    const unsigned char *p;
+                    p = (vi == VALUE_ALL ? buf_same : buf_random) + aligns[ai];
+                    value = vi == VALUE_NONE ? 255 : vi == VALUE_ALL ? 'A' : 'x';
+                    if (!check_impl(&impls[i], p, value, n))
+                        return 1;
+
+                    measure_counters(impls[i].fn, p, value, n, warmups,
+                                     repeats, samples, counts);
+                    counts[counter_count] =
+                        ratio(counts[COUNTER_INSTRUCTIONS],
+                              counts[COUNTER_CYCLES]);
+                    counts[counter_count + 1] =
+                        ratio((double)n, counts[COUNTER_L1D_MISSES]);
+                    counts[counter_count + 2] =
+                        ratio((double)n, counts[COUNTER_LLC_MISSES]);
+
+                    if (format == FORMAT_TABLE) {
+                        printf("%-10s %10zu %5zu %6s |", impls[i].name, n,
+                               aligns[ai], value_names[vi]);
+                        for (j = 0; j < counter_count + 3; ++j)
+                            print_count(counts[j],
+                                        j == counter_count ? " | " : " ");
+                        putchar('\n');
+                    } else if (format == FORMAT_CSV) {
+                        printf("%s,%zu,%zu,%s", impls[i].name, n, aligns[ai],
+                               value_names[vi]);
+                        for (j = 0; j < counter_count + 3; ++j)
+                            print_count(counts[j], ",");
+                        putchar('\n');
+                    } else {
+                        json_begin_row();
+                        printf("\"impl\": \"%s\", \"size\": %zu, "
+                               "\"align\": %zu, \"value\": \"%s\"",
+                               impls[i].name, n, aligns[ai], value_names[vi]);
+                        for (j = 0; j < counter_count + 3; ++j) {
+                            printf(", \"%s\": ",
+                                   j < counter_count
+                                       ? counters[j].name
+                                       : derived[j - counter_count]);
+                            print_count(counts[j], "");
+                        }
+                        putchar('}');
+                    }
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void print_hierarchy_row(size_t n, const char *impl, const char *value,
+                                double bpt, double ceiling) {
+    double gbps = bpt * ticks_per_second / 1e9,
+           pct = ceiling > 0 ? bpt / ceiling * 100 : 0;
+    if (format == FORMAT_TABLE) {
+        printf("%-5s %10zu %-12s %6s | %8.3f %8.2f | %8.1f%%\n",
+               hierarchy_level(n), n, impl, value, bpt, gbps, pct);
+    } else if (format == FORMAT_CSV) {
+        printf("%s,%zu,%s,%s,%.4f,%.3f,%.2f\n", hierarchy_level(n), n, impl,
+               value, bpt, gbps, pct);
+    } else {
+        json_begin_row();
+        printf("\"level\": \"%s\", \"size\": %zu, \"impl\": \"%s\", "
+               "\"value\": \"%s\", \"median_bpt\": %.4f, "
+               "\"median_gbps\": %.3f, \"ceiling_pct\": %.2f}",
+               hierarchy_level(n), n, impl, value, bpt, gbps, pct);
+    }
+    fflush(stdout);
+}
+
+/* every working set is measured with the buffer already in the caches, so
+   it stays resident in the first level it fits in. the ceiling is the
+   fastest of the read kernels at the same size; an implementation close to
+   it is bound by the memory level, one far below it is bound by its own
+   instructions and may still gain from more unrolling or prefetching */
+static int run_hierarchy(void) {
+    int i, si, k;
+    find_ceilings();
+    if (format == FORMAT_TABLE) {
+        printf("caches: L1D %zu KiB, L2 %zu KiB, LLC %zu KiB\n",
+               cache_l1d >> 10, cache_l2 >> 10, cache_llc >> 10);
+        printf("%-5s %10s %-12s %6s | %8s %8s | %9s\n", "level", "size",
+               "impl", "value", "med B/t", "med GB/s", "ceiling");
+    } else if (format == FORMAT_CSV) {
+        puts("level,size,impl,value,median_bpt,median_gbps,ceiling_pct");
+    }
+
+    for (si = 0; si < size_count; ++si) {
+        size_t n = sizes[si];
+        double ceiling = 0;
+        int best = 0;
+        for (i = 0; i < ceiling_count; ++i) {
+            struct bench_result r = measure(ceilings[i].fn, buf_random, 0, n,
+                                            warmups, repeats, samples);
+            double bpt = r.median > 0 ? n / r.median : 0;
+            if (bpt > ceiling) {
+                ceiling = bpt;
+                best = i;
+            }
+        }
+        print_hierarchy_row(n, ceilings[best].name, "-", ceiling, ceiling);
+
+        for (i = 0; i < impl_count; ++i) {
+            for (k = 0; k < value_count; ++k) {
+                int vi = values[k], value;
+                const unsigned char *p;
+                struct bench_result r;
+                p = vi == VALUE_ALL ? buf_same : buf_random;
+                value = vi == VALUE_NONE ? 255 : vi == VALUE_ALL ? 'A' : 'x';
+                if (!check_impl(&impls[i], p, value, n))
+                    return 1;
+                r = measure(impls[i].fn, p, value, n, warmups, repeats,
+                            samples);
+                print_hierarchy_row(n, impls[i].name, value_names[vi],
+                                    r.median > 0 ? n / r.median : 0, ceiling);
+            }
+        }
+    }
+    return 0;
+}
+
+#if CAN_THREAD
+/* for every thread count, each thread counts its own buffer (disjoint) or
+   all of them count the same one (shared). the slowdown is the time each
+   thread takes for the same work relative to the first thread count (which
+   is normally 1) */
+static int run_threads(int huge, int node) {
+    static const char *sharing_names[] = {"disjoint", "shared"};
+    static const char *placement_names[] = {"spread", "packed"};
+    static struct bench_worker w[MAX_THREADS];
+    struct bench_cpu order[MAX_THREADS];
+    size_t stride = 0, mem_size;
+    unsigned char *mem;
+    int i, si, sh, pl, ti, k, max_threads = 0;
+
+    for (ti = 0; ti < thread_count_count; ++ti)
+        if ((int)thread_counts[ti] > max_threads)
+            max_threads = (int)thread_counts[ti];
+    for (si = 0; si < size_count; ++si)
+        if ((sizes[si] + 63) / 64 * 64 > stride)
+            stride = (sizes[si] + 63) / 64 * 64;
+    mem_size = stride * max_threads + 64;
+    if (!(mem = alloc_pages(mem_size, huge, node))) {
+        fputs("could not allocate buffers\n", stderr);
+        return 1;
+    }
+
+    if (format == FORMAT_TABLE) {
+        printf("cpus: %d%s\n", cpu_count,
+               has_smt ? "" : " (no SMT siblings, packed is not measured)");
+        printf("%-10s %10s %-8s %-6s %7s | %10s %10s | %8s\n", "impl", "size",
+               "buffer", "place", "threads", "total GB/s", "per thread",
+               "slowdown");
+    } else if (format == FORMAT_CSV) {
+        puts("impl,size,buffer,placement,threads,total_gbps,thread_gbps,"
+             "slowdown");
+    }
+
+    for (i = 0; i < impl_count; ++i) {
+        for (si = 0; si < size_count; ++si) {
+            size_t n = sizes[si];
+            int value = values[0] == VALUE_NONE  ? 255
+                        : values[0] == VALUE_ALL ? 'A'
+                                                 : 'x';
+            const unsigned char *src =
+                values[0] == VALUE_ALL ? buf_same : buf_random;
+            unsigned long iters;
+            double per_call;
+            if (!check_impl(&impls[i], src, value, n))
+                return 1;
+            iters = batch_iters(impls[i].fn, src, value, n);
+            per_call = time_batch(impls[i].fn, src, value, n, iters) /
+                       ticks_per_second / iters;
+            iters = (unsigned long)(THREAD_RUN_SECONDS / per_call) + 1;
+
+            for (sh = 0; sh < 2; ++sh) {
+                for (pl = 0; pl < (has_smt ? 2 : 1); ++pl) {
+                    double alone = 0;
+                    memcpy(order, cpus, cpu_count * sizeof(*cpus));
+                    qsort(order, cpu_count, sizeof(*cpus),
+                          pl ? compare_cpu_packed : compare_cpu_spread);
+                    for (ti = 0; ti < thread_count_count; ++ti) {
+                        int count = (int)thread_counts[ti];
+                        double total, mean, slowdown;
+                        for (k = 0; k < count; ++k) {
+                            w[k].fn = impls[i].fn;
+                            w[k].src = src;
+                            w[k].buf = sh ? (unsigned char *)src
+                                          : mem + k * stride;
+                            w[k].n = n;
+                            w[k].value = value;
+                            w[k].cpu = order[k % cpu_count].cpu;
+                            w[k].iters = iters;
+                        }
+                        for (k = 0; k < repeats; ++k) {
+                            double longest = 0, sum = 0;
+                            int j;
+                            if (!run_workers(w, count)) {
+                                fputs("could not start threads\n", stderr);
+                                free_pages(mem, mem_size, huge);
+                                return 1;
+                            }
+                            for (j = 0; j < count; ++j) {
+                                sum += w[j].seconds;
+                                if (w[j].seconds > longest)
+                                    longest = w[j].seconds;
+                            }
+                            /* all threads together over the slowest one */
+                            samples[k] =
+                                (double)n * iters * count / longest / 1e9;
+                            samples[repeats + k] = sum / count;
+                        }
+                        qsort(samples, repeats, sizeof(double),
+                              compare_double);
+                        qsort(samples + repeats, repeats, sizeof(double),
+                              compare_double);
+                        total = percentile(samples, repeats, 50);
+                        mean = percentile(samples + repeats, repeats, 50);
+                        if (ti == 0)
+                            alone = mean;
+                        slowdown = alone > 0 ? mean / alone : 0;
+
+                        if (format == FORMAT_TABLE) {
+                            printf("%-10s %10zu %-8s %-6s %7d | %10.2f %10.2f "
+                                   "| %8.2f\n",
+                                   impls[i].name, n, sharing_names[sh],
+                                   placement_names[pl], count, total,
+                                   n * iters / mean / 1e9, slowdown);
+                        } else if (format == FORMAT_CSV) {
+                            printf("%s,%zu,%s,%s,%d,%.3f,%.3f,%.3f\n",
+                                   impls[i].name, n, sharing_names[sh],
+                                   placement_names[pl], count, total,
+                                   n * iters / mean / 1e9, slowdown);
+                        } else {
+                            json_begin_row();
+                            printf("\"impl\": \"%s\", \"size\": %zu, "
+                                   "\"buffer\": \"%s\", \"placement\": "
+                                   "\"%s\", \"threads\": %d, "
+                                   "\"total_gbps\": %.3f, "
+                                   "\"thread_gbps\": %.3f, "
+                                   "\"slowdown\": %.3f}",
+                                   impls[i].name, n, sharing_names[sh],
+                                   placement_names[pl], count, total,
+                                   n * iters / mean / 1e9, slowdown);
+                        }
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+    free_pages(mem, mem_size, huge);
+    return 0;
+}
+#else
+static int run_threads(int huge, int node) {
+    (void)huge, (void)node;
+    fputs("threads are not supported on this platform\n", stderr);
+    return 1;
+}
+#endif
+
+#if CAN_THREAD
+/* queues the segments of the first n bytes on their nodes */
+static void parallel_queue(struct bench_parallel *p, size_t *segs,
+                           size_t n) {
+    size_t s, used = 0;
+    int nd;
+    p->n = n;
+    p->seg_count = (n + PARALLEL_SEGMENT - 1) / PARALLEL_SEGMENT;
+    for (nd = 0; nd < MAX_NODES; ++nd) {
+        struct bench_queue *q = &p->q[nd];
+        q->segs = segs + used;
+        q->count = 0;
+        for (s = 0; s < p->seg_count; ++s)
+            if (p->seg_node[s] == nd)
+                q->segs[q->count++] = s;
+        used += q->count;
+    }
+}
+
+/* refills the queues and counts the threads on each node */
+static void parallel_reset(struct bench_parallel *p,
+                           const struct bench_worker *w, int count) {
+    size_t k;
+    int nd;
+    for (nd = 0; nd < MAX_NODES; ++nd) {
+        struct bench_queue *q = &p->q[nd];
+        q->pos = q->off = q->left = 0;
+        q->workers = 0;
+        for (k = 0; k < q->count; ++k)
+            q->left += q->segs[k] == p->seg_count - 1
+                           ? p->n - q->segs[k] * PARALLEL_SEGMENT
+                           : PARALLEL_SEGMENT;
+    }
+    for (nd = 0; nd < count; ++nd)
+        ++p->q[w[nd].node].workers;
+}
+
+/* the bytes of [at, at + n) on the given node */
+static size_t parallel_local(const struct bench_parallel *p, size_t at,
+                             size_t n, int node) {
+    size_t s, local = 0;
+    for (s = at / PARALLEL_SEGMENT; n; ++s) {
+        size_t len = PARALLEL_SEGMENT - at % PARALLEL_SEGMENT;
+        if (len > n)
+            len = n;
+        if (p->seg_node[s] == node)
+            local += len;
+        at += len, n -= len;
+    }
+    return local;
+}
+
+/* for every thread count, counts one buffer once with each scheme, with the
+   threads on the same CPUs (spread) for both */
+static int run_parallel(int huge, int node) {
+    static const char *scheme_names[] = {"even", "topology"};
+    static struct bench_worker w[MAX_THREADS];
+    static struct bench_parallel par;
+    struct bench_cpu order[MAX_THREADS];
+    size_t max_n = 0, seg_count, s, *segs;
+    unsigned char *mem;
+    void **pages;
+    int i, si, sc, ti, k, node_count = 0, min_capacity = FULL_CAPACITY;
+    int node_list[MAX_NODES], has_node[MAX_NODES] = {0};
+
+    for (si = 0; si < size_count; ++si)
+        if (sizes[si] > max_n)
+            max_n = sizes[si];
+    seg_count = (max_n + PARALLEL_SEGMENT - 1) / PARALLEL_SEGMENT;
+    mem = alloc_pages(max_n, huge, node);
+    segs = malloc(seg_count * sizeof(size_t));
+    pages = malloc(seg_count * sizeof(void *));
+    par.seg_node = malloc(seg_count * sizeof(int));
+    if (!mem || !segs || !pages || !par.seg_node) {
+        fputs("could not allocate buffers\n", stderr);
+        return 1;
+    }
+    par.buf = mem;
+
+    for (i = 0; i < cpu_count; ++i) {
+        if (!has_node[cpus[i].node]++)
+            node_list[node_count++] = cpus[i].node;
+        if (cpus[i].capacity < min_capacity)
+            min_capacity = cpus[i].capacity;
+    }
+    /* without -n, the segments go to the nodes in turn */
+    if (node < 0 && node_count > 1)
+        for (s = 0; s < seg_count; ++s)
+            if (bind_pages(mem + s * PARALLEL_SEGMENT,
+                           s + 1 < seg_count ? PARALLEL_SEGMENT
+                                             : max_n - s * PARALLEL_SEGMENT,
+                           node_list[s % node_count])) {
+                fputs("warning: could not spread the buffer over the NUMA "
+                      "nodes\n",
+                      stderr);
+                break;
+            }
+    /* the pages are placed as they are written */
+    memcpy(mem, values[0] == VALUE_ALL ? buf_same : buf_random, max_n);
+    for (s = 0; s < seg_count; ++s)
+        pages[s] = mem + s * PARALLEL_SEGMENT;
+    pages_nodes(pages, par.seg_node, seg_count);
+    for (s = 0; s < seg_count; ++s)
+        if (par.seg_node[s] < 0 || par.seg_node[s] >= MAX_NODES)
+            par.seg_node[s] = node_list[0];
+
+    memcpy(order, cpus, cpu_count * sizeof(*cpus));
+    qsort(order, cpu_count, sizeof(*cpus), compare_cpu_spread);
+
+    if (format == FORMAT_TABLE) {
+        printf("cpus: %d, nodes: %d, slowest core: %d%% of the fastest\n",
+               cpu_count, node_count, min_capacity * 100 / FULL_CAPACITY);
+        printf("%-10s %10s %-8s %7s | %10s %7s %7s\n", "impl", "size",
+               "scheme", "threads", "total GB/s", "local %", "wait %");
+    } else if (format == FORMAT_CSV) {
+        puts("impl,size,scheme,threads,total_gbps,local_pct,wait_pct");
+    }
+
+    for (i = 0; i < impl_count; ++i) {
+        for (si = 0; si < size_count; ++si) {
+            size_t n = sizes[si], expected;
+            int value = values[0] == VALUE_NONE  ? 255
+                        : values[0] == VALUE_ALL ? 'A'
+                                                 : 'x';
+            if (!check_impl(&impls[i], mem, value, n))
+                return 1;
+            expected = impls[i].fn(mem, value, n);
+            parallel_queue(&par, segs, n);
+
+            for (ti = 0; ti < thread_count_count; ++ti) {
+                int count = (int)thread_counts[ti];
+                for (sc = 0; sc < 2; ++sc) {
+                    double total, local, wait;
+                    par.even = !sc;
+                    for (k = 0; k < count; ++k) {
+                        size_t at = n / count * k;
+                        w[k].fn = impls[i].fn;
+                        w[k].par = &par;
+                        w[k].cpu = order[k % cpu_count].cpu;
+                        w[k].node = order[k % cpu_count].node;
+                        w[k].capacity = order[k % cpu_count].capacity;
+                        w[k].value = value;
+                        w[k].iters = 1;
+                        /* the last thread takes the remainder */
+                        w[k].src = w[k].buf = mem + at;
+                        w[k].n = k + 1 < count ? n / count : n - at;
+                    }
+                    for (k = 0; k < repeats; ++k) {
+                        double first = 0, last = 0, wall, idle = 0;
+                        size_t sum = 0, local_sum = 0;
+                        int j;
+                        parallel_reset(&par, w, count);
+                        for (j = 0; j < count; ++j)
+                            w[j].local =
+                                par.even ? parallel_local(&par, w[j].buf - mem,
+                                                          w[j].n, w[j].node)
+                                         : 0;
+                        if (!run_workers(w, count)) {
+                            fputs("could not start threads\n", stderr);
+                            free_pages(mem, max_n, huge);
+                            return 1;
+                        }
+                        /* from the first start to the last finish */
+                        for (j = 0; j < count; ++j) {
+                            sum += w[j].result;
+                            local_sum += w[j].local;
+                            if (!j || w[j].start < first)
+                                first = w[j].start;
+                            if (w[j].start + w[j].seconds > last)
+                                last = w[j].start + w[j].seconds;
+                        }
+                        wall = last - first;
+                        if (sum != expected) {
+                            printf("%s counted %zu with %d threads (%s); "
+                                   "should be %zu\n",
+                                   impls[i].name, sum, count,
+                                   scheme_names[sc], expected);
+                            free_pages(mem, max_n, huge);
+                            return 1;
+                        }
+                        for (j = 0; j < count; ++j)
+                            idle += wall - w[j].seconds;
+                        samples[k] = (double)n / wall / 1e9;
+                        samples[repeats + k] = 100.0 * local_sum / n;
+                        samples[2 * repeats + k] =
+                            wall > 0 ? 100.0 * idle / count / wall : 0;
+                    }
+                    for (k = 0; k < 3; ++k)
+                        qsort(samples + k * repeats, repeats, sizeof(double),
+                              compare_double);
+                    total = percentile(samples, repeats, 50);
+                    local = percentile(samples + repeats, repeats, 50);
+                    wait = percentile(samples + 2 * repeats, repeats, 50);
+
+                    if (format == FORMAT_TABLE) {
+                        printf("%-10s %10zu %-8s %7d | %10.2f %7.1f %7.1f\n",
+                               impls[i].name, n, scheme_names[sc], count,
+                               total, local, wait);
+                    } else if (format == FORMAT_CSV) {
+                        printf("%s,%zu,%s,%d,%.3f,%.2f,%.2f\n",
+                               impls[i].name, n, scheme_names[sc], count,
+                               total, local, wait);
+                    } else {
+                        json_begin_row();
+                        printf("\"impl\": \"%s\", \"size\": %zu, "
+                               "\"scheme\": \"%s\", \"threads\": %d, "
+                               "\"total_gbps\": %.3f, "
+                               "\"local_pct\": %.2f, \"wait_pct\": %.2f}",
+                               impls[i].name, n, scheme_names[sc], count,
+                               total, local, wait);
+                    }
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    free(par.seg_node);
+    free(pages);
+    free(segs);
+    free_pages(mem, max_n, huge);
+    return 0;
+}
+#else
+static int run_parallel(int huge, int node) {
+    (void)huge, (void)node;
+    fputs("threads are not supported on this platform\n", stderr);
+    return 1;
+}
+#endif
+
+/* =============================
+           standard input
+   ============================= */
+
+#if IS_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* compressed input is decompressed if built with these (and linked with
+   -lz or -lzstd) */
+#ifndef BENCH_ZLIB
+#define BENCH_ZLIB 0
+#endif
+#ifndef BENCH_ZSTD
+#define BENCH_ZSTD 0
+#endif
+#if BENCH_ZLIB
+#include <zlib.h>
+#endif
+#if BENCH_ZSTD
+#include <zstd.h>
+#endif
+
+/* the plain way: one thread, read() into a buffer and count */
+#define READ_BUFFER_SIZE ((size_t)64 << 10)
+/* the ring: a reader thread reads into slots that the counting thread
+   counts, so that the reads and counting overlap */
+#define RING_SLOTS 8
+#define RING_SLOT_SIZE ((size_t)1 << 20)
+/* decompressed data is written and read back right away, so the slots are
+   smaller, to keep the whole ring in the last-level cache */
+#define RING_CACHED_SLOT_SIZE ((size_t)256 << 10)
+/* compressed input is read this much at a time */
+#define SOURCE_INPUT_SIZE ((size_t)256 << 10)
+
+enum bench_source_kind { SOURCE_RAW, SOURCE_GZIP, SOURCE_ZSTD };
+static const char *source_names[] = {"raw", "gzip", "zstd"};
+
+/* the input, decompressed if it starts like gzip or zstd data */
+struct bench_source {
+    /* partial: in the middle of a compressed stream */
+    int fd, kind, eof, partial;
+    /* the first bytes, read to tell what the input is */
+    unsigned char head[4];
+    size_t head_len, head_pos;
+    /* compressed input waiting to be decompressed */
+    unsigned char *in;
+    size_t in_pos, in_len;
+    const char *error;
+#if BENCH_ZLIB
+    z_stream z;
+#endif
+#if BENCH_ZSTD
+    ZSTD_DCtx *zd;
+#endif
+};
+
+/* reads up to n bytes, the head first. returns the bytes read, 0 at the end
+   or -1 for an error */
+static long source_read(struct bench_source *s, unsigned char *p, size_t n) {
+    ssize_t r;
+    if (s->head_pos < s->head_len) {
+        if (n > s->head_len - s->head_pos)
+            n = s->head_len - s->head_pos;
+        memcpy(p, s->head + s->head_pos, n);
+        s->head_pos += n;
+        return (long)n;
+    }
+    while ((r = read(s->fd, p, n)) < 0 && errno == EINTR)
+        ;
+    if (r < 0)
+        s->error = strerror(errno);
+    return (long)r;
+}
+
+/* reads more compressed input if all of it has been used. returns 0 if
+   OK */
+static int source_refill(struct bench_source *s) {
+    long got;
+    if (s->in_pos < s->in_len || s->eof)
+        return 0;
+    if ((got = source_read(s, s->in, SOURCE_INPUT_SIZE)) < 0)
+        return -1;
+    s->in_pos = 0;
+    s->in_len = (size_t)got;
+    s->eof = !got;
+    return 0;
+}
+
+/* reads the head and sets up the decompressor it calls for. returns 0 if
+   OK */
+static int source_open(struct bench_source *s, int fd) {
+    long got;
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    while (s->head_len < sizeof(s->head)) {
+        if ((got = source_read(s, s->head + s->head_len,
+                               sizeof(s->head) - s->head_len)) < 0)
+            return -1;
+        if (!got)
+            break;
+        s->head_len += (size_t)got;
+    }
+    if (s->head_len >= 2 && s->head[0] == 0x1f && s->head[1] == 0x8b)
+        s->kind = SOURCE_GZIP;
+    else if (s->head_len >= 4 && s->head[0] == 0x28 && s->head[1] == 0xb5 &&
+             s->head[2] == 0x2f && s->head[3] == 0xfd)
+        s->kind = SOURCE_ZSTD;
+    if (s->kind == SOURCE_RAW)
+        return 0;
+    if (!(s->in = malloc(SOURCE_INPUT_SIZE))) {
+        s->error = "out of memory";
+        return -1;
+    }
+#if BENCH_ZLIB
+    /* 15 + 32: any window size, and tell gzip and zlib headers apart */
+    if (s->kind == SOURCE_GZIP && inflateInit2(&s->z, 15 + 32) == Z_OK)
+        return 0;
+#endif
+#if BENCH_ZSTD
+    if (s->kind == SOURCE_ZSTD && (s->zd = ZSTD_createDCtx()))
+        return 0;
+#endif
+    s->error = s->kind == SOURCE_GZIP
+                   ? "gzip input, but not built with -DBENCH_ZLIB=1 -lz"
+                   : "zstd input, but not built with -DBENCH_ZSTD=1 -lzstd";
+    return -1;
+}
+
+static void source_close(struct bench_source *s) {
+#if BENCH_ZLIB
+    if (s->kind == SOURCE_GZIP)
+        inflateEnd(&s->z);
+#endif
+#if BENCH_ZSTD
+    if (s->kind == SOURCE_ZSTD)
+        ZSTD_freeDCtx(s->zd);
+#endif
+    free(s->in);
+}
+
+/* fills p with n bytes of (decompressed) input, or fewer at the end. returns
+   the bytes or -1 for an error */
+static long source_fill(struct bench_source *s, unsigned char *p, size_t n) {
+    size_t got = 0;
+    long r;
+    while (got < n) {
+        if (s->kind == SOURCE_RAW) {
+            if ((r = source_read(s, p + got, n - got)) < 0)
+                return -1;
+            if (!r)
+                break;
+            got += (size_t)r;
+            continue;
+        }
+        if (source_refill(s))
+            return -1;
+        if (s->eof && s->partial) {
+            s->error = "unexpected end of compressed data";
+            return -1;
+        }
+#if BENCH_ZLIB
+        if (s->kind == SOURCE_GZIP) {
+            int err;
+            if (s->eof)
+                break;
+            s->z.next_in = s->in + s->in_pos;
+            s->z.avail_in = (uInt)(s->in_len - s->in_pos);
+            s->z.next_out = p + got;
+            s->z.avail_out = (uInt)(n - got);
+            err = inflate(&s->z, Z_NO_FLUSH);
+            got = n - s->z.avail_out;
+            s->in_pos = s->in_len - s->z.avail_in;
+            s->partial = err != Z_STREAM_END;
+            if (err == Z_STREAM_END) {
+                /* concatenated members, like gzip -c a b */
+                if (inflateReset(&s->z) != Z_OK) {
+                    s->error = "zlib error";
+                    return -1;
+                }
+            } else if (err != Z_OK && err != Z_BUF_ERROR) {
+                s->error = s->z.msg ? s->z.msg : "corrupt gzip data";
+                return -1;
+            }
+        }
+#endif
+#if BENCH_ZSTD
+        if (s->kind == SOURCE_ZSTD) {
+            ZSTD_inBuffer in;
+            ZSTD_outBuffer out;
+            size_t err;
+            if (s->eof)
+                break;
+            in.src = s->in;
+            in.size = s->in_len;
+            in.pos = s->in_pos;
+            out.dst = p;
+            out.size = n;
+            out.pos = got;
+            err = ZSTD_decompressStream(s->zd, &out, &in);
+            if (ZSTD_isError(err)) {
+                s->error = ZSTD_getErrorName(err);
+                return -1;
+            }
+            got = out.pos;
+            s->in_pos = in.pos;
+            /* 0 at the end of a frame */
+            s->partial = err != 0;
+        }
+#endif
+    }
+    return (long)got;
+}
+
+struct bench_ring {
+    struct bench_source *src;
+    unsigned char *mem;
+    size_t slot, len[RING_SLOTS];
+    /* the reader has filled the slots up to head, the counter counted them
+       up to tail */
+    unsigned long head, tail;
+    int done, failed, cpu;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void *ring_reader(void *arg) {
+    struct bench_ring *r = (struct bench_ring *)arg;
+    int done = 0;
+    if (r->cpu >= 0)
+        pin_cpu(r->cpu);
+    while (!done) {
+        unsigned char *slot;
+        long got;
+        pthread_mutex_lock(&r->lock);
+        while (r->head - r->tail == RING_SLOTS)
+            pthread_cond_wait(&r->cond, &r->lock);
+        slot = r->mem + (r->head % RING_SLOTS) * r->slot;
+        pthread_mutex_unlock(&r->lock);
+
+        /* whole slots, so that the counter is woken up once per slot */
+        got = source_fill(r->src, slot, r->slot);
+        done = got < (long)r->slot;
+
+        pthread_mutex_lock(&r->lock);
+        if (got < 0)
+            r->failed = 1, got = 0;
+        r->len[r->head % RING_SLOTS] = (size_t)got;
+        ++r->head;
+        r->done = done;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+    }
+    return NULL;
+}
+
+/* counts with fn what can be read from src with a reader thread on the
+   given CPU (-1 for any) into *count. returns the bytes counted, or -1 */
+static double count_ring(bench_fn_t fn, struct bench_source *src, int value,
+                         int cpu, size_t *count) {
+    static struct bench_ring r;
+    pthread_t thread;
+    double bytes = 0;
+    int done = 0;
+    memset(&r, 0, sizeof(r));
+    r.src = src;
+    r.cpu = cpu;
+    r.slot = src->kind == SOURCE_RAW ? RING_SLOT_SIZE : RING_CACHED_SLOT_SIZE;
+    r.mem = alloc_pages(RING_SLOTS * r.slot, 0, -1);
+    if (!r.mem)
+        return -1;
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.cond, NULL);
+#if defined(F_SETPIPE_SZ)
+    /* a pipe as large as a slot needs fewer wake-ups of the reader; it is
+       limited by /proc/sys/fs/pipe-max-size, so try smaller ones too */
+    {
+        int size;
+        for (size = (int)RING_SLOT_SIZE; size > 65536; size /= 2)
+            if (fcntl(src->fd, F_SETPIPE_SZ, size) >= 0)
+                break;
+    }
+#endif
+    if (pthread_create(&thread, NULL, ring_reader, &r)) {
+        free_pages(r.mem, RING_SLOTS * r.slot, 0);
+        return -1;
+    }
+    *count = 0;
+    while (!done) {
+        size_t n;
+        pthread_mutex_lock(&r.lock);
+        while (r.head == r.tail)
+            pthread_cond_wait(&r.cond, &r.lock);
+        n = r.len[r.tail % RING_SLOTS];
+        done = r.done && r.head - r.tail == 1;
+        pthread_mutex_unlock(&r.lock);
+
+        *count += fn(r.mem + (r.tail % RING_SLOTS) * r.slot, value, n);
+        bytes += (double)n;
+
+        pthread_mutex_lock(&r.lock);
+        ++r.tail;
+        pthread_cond_broadcast(&r.cond);
+        pthread_mutex_unlock(&r.lock);
+    }
+    pthread_join(thread, NULL);
+    free_pages(r.mem, RING_SLOTS * r.slot, 0);
+    pthread_mutex_destroy(&r.lock);
+    pthread_cond_destroy(&r.cond);
+    return r.failed ? -1 : bytes;
+}
+
+static double count_read(bench_fn_t fn, struct bench_source *src, int value,
+                         size_t *count) {
+    static unsigned char buffer[READ_BUFFER_SIZE];
+    double bytes = 0;
+    long got;
+    *count = 0;
+    while ((got = source_fill(src, buffer, sizeof(buffer))) > 0) {
+        *count += fn(buffer, value, (size_t)got);
+        bytes += (double)got;
+    }
+    return got < 0 ? -1 : bytes;
+}
+
+/* a regular file is mapped and counted in place without any copies, unless
+   it is compressed. returns -1 if it was not counted */
+static double count_mapped(bench_fn_t fn, int fd, int value, size_t *count) {
+    struct stat st;
+    unsigned char *p;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return -1;
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    if (st.st_size >= 4 &&
+        ((p[0] == 0x1f && p[1] == 0x8b) ||
+         (p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd))) {
+        munmap(p, (size_t)st.st_size);
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+    *count = fn(p, value, (size_t)st.st_size);
+    munmap(p, (size_t)st.st_size);
+    return (double)st.st_size;
+}
+
+/* counts the newlines of standard input, like wc -l, with the first
+   implementation. the reader thread goes on another core if there is one */
+static int run_stdin(int cpu, int ring) {
+    static const char *method_names[] = {"read", "ring", "mmap"};
+    static struct bench_source src;
+    size_t count = 0;
+    double t0 = getseconds(), seconds, bytes;
+    int method = 2, kind = SOURCE_RAW, i, reader_cpu = -1, core = -1,
+        package = -1;
+
+    for (i = 0; i < cpu_count; ++i)
+        if (cpus[i].cpu == cpu)
+            core = cpus[i].core, package = cpus[i].package;
+    for (i = 0; i < cpu_count && reader_cpu < 0; ++i)
+        if (cpus[i].core != core || cpus[i].package != package)
+            reader_cpu = cpus[i].cpu;
+
+    bytes = count_mapped(impls[0].fn, 0, '\n', &count);
+    if (bytes < 0) {
+        method = ring;
+        if (source_open(&src, 0)) {
+            fprintf(stderr, "could not read standard input: %s\n",
+                    src.error);
+            source_close(&src);
+            return 1;
+        }
+        kind = src.kind;
+        bytes = ring ? count_ring(impls[0].fn, &src, '\n', reader_cpu, &count)
+                     : count_read(impls[0].fn, &src, '\n', &count);
+        source_close(&src);
+        if (bytes < 0) {
+            fprintf(stderr, "could not read standard input: %s\n",
+                    src.error ? src.error : "out of memory");
+            return 1;
+        }
+    }
+    seconds = getseconds() - t0;
+
+    if (format == FORMAT_TABLE) {
+        printf("%-10s %-6s %-5s %14s %14s %10s %10s\n", "impl", "method",
+               "input", "bytes", "newlines", "seconds", "GB/s");
+        printf("%-10s %-6s %-5s %14.0f %14zu %10.4f %10.3f\n", impls[0].name,
+               method_names[method], source_names[kind], bytes, count,
+               seconds, seconds > 0 ? bytes / seconds / 1e9 : 0);
+    } else if (format == FORMAT_CSV) {
+        puts("impl,method,input,bytes,newlines,seconds,gbps");
+        printf("%s,%s,%s,%.0f,%zu,%.6f,%.3f\n", impls[0].name,
+               method_names[method], source_names[kind], bytes, count,
+               seconds, seconds > 0 ? bytes / seconds / 1e9 : 0);
+    } else {
+        json_begin_row();
+        printf("\"impl\": \"%s\", \"method\": \"%s\", \"input\": \"%s\", "
+               "\"bytes\": %.0f, \"newlines\": %zu, \"seconds\": %.6f, "
+               "\"gbps\": %.3f}",
+               impls[0].name, method_names[method], source_names[kind], bytes,
+               count, seconds, seconds > 0 ? bytes / seconds / 1e9 : 0);
+    }
+    return 0;
+}
+#else
+static int run_stdin(int cpu, int ring) {
+    (void)cpu, (void)ring;
+    fputs("reading standard input is not supported on this platform\n",
+          stderr);
+    return 1;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    static const size_t default_sizes[] = {
+        16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576, 16777216};
+    static const size_t default_aligns[] = {0, 1, 33};
+    size_t max_size = 0, mem_size;
+    int mode = MODE_THROUGHPUT, cpu = -1, result, huge = 0, node = -1;
+    int ring = 1;
+    const char *impl_filter = NULL, *value_filter = NULL, *node_arg = NULL;
+    const char *raw_events = NULL, *record_fn = NULL, *baseline_fn = NULL;
+    unsigned char *mem;
+    int i, k, si, ai, vi;
+
+    size_count = align_count = repeats = 0;
+    warmups = 3;
+    for (i = 1; i < argc; ++i) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a[0] != '-' || !a[1] || a[2] || !v) {
+            usage();
+            return 2;
+        }
+        ++i;
+        switch (a[1]) {
+        case 'm':
+            if (!strcmp(v, "throughput"))
+                mode = MODE_THROUGHPUT;
+            else if (!strcmp(v, "latency"))
+                mode = MODE_LATENCY;
+            else if (!strcmp(v, "counters"))
+                mode = MODE_COUNTERS;
+            else if (!strcmp(v, "hierarchy"))
+                mode = MODE_HIERARCHY;
+            else if (!strcmp(v, "threads"))
+                mode = MODE_THREADS;
+            else if (!strcmp(v, "parallel"))
+                mode = MODE_PARALLEL;
+            else if (!strcmp(v, "stdin"))
+                mode = MODE_STDIN;
+            else {
+                usage();
+                return 2;
+            }
+            break;
+        case 'f':
+            if (!strcmp(v, "table"))
+                format = FORMAT_TABLE;
+            else if (!strcmp(v, "csv"))
+                format = FORMAT_CSV;
+            else if (!strcmp(v, "json"))
+                format = FORMAT_JSON;
+            else {
+                usage();
+                return 2;
+            }
+            break;
+        case 'i':
+            impl_filter = v;
+            break;
+        case 's':
+            if ((size_count = parse_list(v, sizes, MAX_LIST)) <= 0) {
+                usage();
+                return 2;
+            }
+            break;
+        case 'a':
+            if ((align_count = parse_list(v, aligns, MAX_LIST)) <= 0) {
+                usage();
+                return 2;
+            }
+            break;
+        case 'v':
+            value_filter = v;
+            break;
+        case 'r':
+            if ((repeats = atoi(v)) <= 0) {
+                usage();
+                return 2;
+            }
+            break;
+        case 'w':
+            warmups = atoi(v);
+            break;
+        case 'c':
+            cpu = atoi(v);
+            break;
+        case 'e':
+            raw_events = v;
+            break;
+        case 'o':
+            record_fn = v;
+            break;
+        case 'b':
+            baseline_fn = v;
+            break;
+        case 't':
+            if ((tolerance = atof(v)) < 0) {
+                usage();
+                return 2;
+            }
+            break;
+        case 'p':
+            if (!strcmp(v, "small"))
+                huge = 0;
+            else if (!strcmp(v, "huge"))
+                huge = 1;
+            else {
+                usage();
+                return 2;
+            }
+            break;
+        case 'n':
+            node_arg = v;
+            break;
+        case 'I':
+            if (!strcmp(v, "read"))
+                ring = 0;
+            else if (!strcmp(v, "ring"))
+                ring = 1;
+            else {
+                usage();
+                return 2;
+            }
+            break;
+        case 'T':
+            thread_count_count = parse_list(v, thread_counts, MAX_LIST);
+            for (k = 0; k < thread_count_count; ++k)
+                if (!thread_counts[k] || thread_counts[k] > MAX_THREADS)
+                    thread_count_count = -1;
+            if (thread_count_count <= 0) {
+                usage();
+                return 2;
+            }
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (warmups < 0 ||
+        ((record_fn || baseline_fn) && mode != MODE_THROUGHPUT)) {
+        usage();
+        return 2;
+    }
+
+    if (mode == MODE_LATENCY) {
+        if (!size_count)
+            size_count = fill_range(sizes, 0, 1024);
+        if (!align_count)
+            align_count = fill_range(aligns, 0, 63);
+        if (!repeats)
+            repeats = 7;
+    } else if (mode == MODE_HIERARCHY) {
+        size_t levels[4];
+        int level_count;
+        find_cache_sizes();
+        level_count = hierarchy_sizes(levels);
+        if (!size_count) {
+            size_count = level_count;
+            memcpy(sizes, levels, sizeof(levels));
+        }
+        /* the read kernels need whole 64-byte blocks at an aligned address */
+        for (si = 0; si < size_count; ++si)
+            sizes[si] &= ~(size_t)63;
+        align_count = 1;
+        aligns[0] = 0;
+        if (!value_filter)
+            value_filter = "sparse";
+        if (!repeats)
+            repeats = 11;
+    } else if (mode == MODE_THREADS || mode == MODE_PARALLEL) {
+        static const size_t default_thread_sizes[] = {262144, 16777216};
+        find_topology();
+        if (!size_count && mode == MODE_PARALLEL) {
+            size_count = 1;
+            sizes[0] = (size_t)256 << 20;
+        } else if (!size_count) {
+            size_count = 2;
+            memcpy(sizes, default_thread_sizes, sizeof(default_thread_sizes));
+        }
+        if (!thread_count_count) {
+            /* 1, 2, 4, ... and every CPU */
+            for (k = 1; k < cpu_count; k *= 2)
+                thread_counts[thread_count_count++] = k;
+            thread_counts[thread_count_count++] = cpu_count;
+        }
+        align_count = 1;
+        aligns[0] = 0;
+        if (!value_filter)
+            value_filter = "sparse";
+        if (!repeats)
+            repeats = 5;
+    } else if (mode == MODE_STDIN) {
+        find_topology();
+        /* only for checking the implementations */
+        size_count = align_count = 1;
+        sizes[0] = 4096;
+        aligns[0] = 0;
+        if (!value_filter)
+            value_filter = "sparse";
+        repeats = 1;
+    } else {
+        if (!size_count) {
+            size_count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+            memcpy(sizes, default_sizes, sizeof(default_sizes));
+        }
+        if (!align_count) {
+            align_count = sizeof(default_aligns) / sizeof(default_aligns[0]);
+            memcpy(aligns, default_aligns, sizeof(default_aligns));
+        }
+        if (!repeats)
+            repeats = mode == MODE_COUNTERS ? 11 : 31;
+    }
+
+    if (!value_filter)
+        value_filter = "none,sparse,all";
+    for (vi = 0; vi < VALUE_COUNT; ++vi)
+        if (in_name_list(value_filter, value_names[vi]))
+            values[value_count++] = vi;
+    for (si = 0; si < size_count; ++si)
+        if (sizes[si] > max_size)
+            max_size = sizes[si];
+    for (ai = 0; ai < align_count; ++ai)
+        aligns[ai] &= 63;
+
+    find_impls();
+    if (impl_filter) {
+        for (i = k = 0; i < impl_count; ++i)
+            if (in_name_list(impl_filter, impls[i].name))
+                impls[k++] = impls[i];
+        impl_count = k;
+    }
+    /* the fastest one, unless asked for */
+    if ((mode == MODE_THREADS || mode == MODE_PARALLEL ||
+         mode == MODE_STDIN) &&
+        !impl_filter && impl_count)
+        impl_count = 1;
+    if (!impl_count || !value_count) {
+        fputs("nothing to benchmark\n", stderr);
+        return 2;
+    }
+
+    if (mode == MODE_COUNTERS) {
+        int err = open_counters(raw_events);
+        if (err) {
+            if (err == -2)
+                usage();
+            return err == -2 ? 2 : 1;
+        }
+    }
+
+    if (baseline_fn && load_baselines(baseline_fn))
+        return 1;
+    if (record_fn) {
+        if (!(record_file = fopen(record_fn, "w"))) {
+            perror(record_fn);
+            return 1;
+        }
+        write_baseline_header(record_file);
+    }
+
+    cpu = pin_cpu(cpu);
+    if (cpu < 0)
+        fputs("warning: could not pin to a CPU, results may be noisy\n",
+              stderr);
+    ticks_per_second = calibrate_ticks_per_second();
+
+    if (node_arg) {
+        node = current_node();
+        if (!strcmp(node_arg, "remote"))
+            node = other_node(node);
+        else if (strcmp(node_arg, "local"))
+            node = atoi(node_arg);
+        if (node < 0) {
+            fprintf(stderr, "no %s NUMA node found\n", node_arg);
+            return 1;
+        }
+    }
+
+    /* two buffers, each aligned to 64 bytes with room for the offset */
+    mem_size = 2 * (max_size + 128);
+    mem = alloc_pages(mem_size, huge, node);
+    samples = malloc(repeats *
+                     (MAX_COUNTERS > MAX_RESAMPLE ? MAX_COUNTERS : MAX_RESAMPLE) *
+                     sizeof(double));
+    if (!mem || !samples) {
+        fputs("could not allocate buffers\n", stderr);
+        return 1;
+    }
+    buf_random = mem + (64 - ((uintptr_t)mem & 63));
+    buf_same = buf_random + ((max_size + 64 + 63) & ~(size_t)63);
+    srand(1);
+    for (i = 0; (size_t)i < max_size + 64; ++i)
+        buf_random[i] = (unsigned char)(rand() % 255);
+    memset(buf_same, 'A', max_size + 64);
+
+    if (format == FORMAT_TABLE) {
+        printf("timer: %s (%.0f ticks/s)%s, cpu %d\n", TICK_METHOD,
+               ticks_per_second,
+               TICK_CYCLES ? " [ticks are reference cycles]" : "", cpu);
+        if (huge || node_arg || mode == MODE_HIERARCHY)
+            printf("buffer: %s pages, node %d\n", page_info,
+                   page_node(buf_random));
+    } else if (format == FORMAT_JSON) {
+        printf("{\n  \"mode\": \"%s\",\n  \"timer\": \"%s\",\n"
+               "  \"ticks_are_cycles\": %s,\n"
+               "  \"ticks_per_second\": %.0f,\n  \"cpu\": %d,\n"
+               "  \"pages\": \"%s\",\n  \"node\": %d,\n"
+               "  \"results\": [",
+               mode_names[mode], TICK_METHOD,
+               TICK_CYCLES ? "true" : "false", ticks_per_second, cpu,
+               page_info, page_node(buf_random));
+    }
+
+    if (mode == MODE_LATENCY)
+        result = run_latency();
+    else if (mode == MODE_HIERARCHY)
+        result = run_hierarchy();
+    else if (mode == MODE_THREADS)
+        result = run_threads(huge, node);
+    else if (mode == MODE_PARALLEL)
+        result = run_parallel(huge, node);
+    else if (mode == MODE_STDIN)
+        result = run_stdin(cpu, ring);
+    else if (mode == MODE_COUNTERS)
+        result = run_counters();
+    else if (baseline_fn)
+        result = run_compare();
+    else
+        result = run_throughput();
+
+    if (format == FORMAT_JSON && result != 1)
+        puts("\n  ]\n}");
+    if (record_file && fclose(record_file)) {
+        perror(record_fn);
+        result = 1;
+    }
+    free(baselines);
+    free(samples);
+    free_pages(mem, mem_size, huge);
+    return result;
+}
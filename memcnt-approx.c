@@ -0,0 +1,163 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_approx (for estimating the count in a large buffer from a sample).
+   this file is included by memcnt.c after the memcnt implementations.
+
+   the buffer is split into strata of equal length, and two blocks of
+   MEMCNT_APPROX_BLOCK bytes, aligned to cache lines, are counted with memcnt
+   in each: one from a random position in each half. each stratum is thus
+   represented in proportion to its length however the values are spread
+   over the buffer. the variance of the estimate is taken from the
+   differences within each pair of blocks. if the error bound is not within
+   the target, the sample is taken again with as many more strata as the
+   bound predicts are needed, so the cost depends on the error target and the
+   spread of the data rather than on n. once the sample would cover much of
+   the buffer, it is simply counted in full.
+
+   this does not need libm (which WebAssembly builds without libc lack). */
+
+#include "memcnt-impl.h"
+
+#ifndef MEMCNT_APPROX_BLOCK
+#define MEMCNT_APPROX_BLOCK 4096
+#endif
+
+/* the blocks start at multiples of this (a cache line) */
+#define MEMCNT_APPROX_ALIGN 64
+
+/* the number of strata in the first sample */
+#define MEMCNT_APPROX_STRATA 16
+
+/* xorshift, 32 bits in an unsigned long */
+INLINE size_t memcnt_approx_rand_(unsigned long *x, size_t range) {
+    size_t r;
+    *x ^= (*x << 13) & 0xFFFFFFFFUL;
+    *x ^= *x >> 17;
+    *x ^= (*x << 5) & 0xFFFFFFFFUL;
+    r = (size_t)*x;
+    if (range > 0xFFFFFFFFUL) {
+        *x ^= (*x << 13) & 0xFFFFFFFFUL;
+        *x ^= *x >> 17;
+        *x ^= (*x << 5) & 0xFFFFFFFFUL;
+        /* shifted twice, since size_t may be 32 bits */
+        r = r << 16 << 16 | (size_t)*x;
+    }
+    return r % range;
+}
+
+INLINE double memcnt_approx_sqrt_(double x) {
+    double r = x > 1 ? x : 1;
+    int i;
+    if (x <= 0)
+        return 0;
+    /* the Newton iteration for r * r = x */
+    for (i = 0; i < 64 && r * r - x > x * 1e-12; ++i)
+        r = (r + x / r) / 2;
+    return r;
+}
+
+/* the two-sided quantile of the normal distribution for the confidence,
+   interpolated between some well-known values */
+INLINE double memcnt_approx_z_(double confidence) {
+    static const double conf[] = {0.5,  0.8,   0.9,   0.95,  0.98,
+                                  0.99, 0.995, 0.999, 0.9999};
+    static const double z[] = {0.6745, 1.2816, 1.6449, 1.9600, 2.3263,
+                               2.5758, 2.8070, 3.2905, 3.8906};
+    int i;
+    if (!(confidence > conf[0]))
+        return z[0];
+    for (i = 1; i < (int)(sizeof(conf) / sizeof(conf[0])); ++i)
+        if (confidence <= conf[i])
+            return z[i - 1] + (z[i] - z[i - 1]) * (confidence - conf[i - 1]) /
+                                  (conf[i] - conf[i - 1]);
+    return z[i - 1];
+}
+
+size_t memcnt_approx(const void *s, int c, size_t n, double rel_error,
+                     double confidence, size_t *bound) {
+    const unsigned char *p = (const unsigned char *)s;
+    /* the seed depends on the buffer, so that the result is repeatable */
+    unsigned long seed = (unsigned long)((n ^ (size_t)p) & 0xFFFFFFFFUL) |
+                         0x9E3779B9UL;
+    double z = memcnt_approx_z_(confidence);
+    size_t strata = MEMCNT_APPROX_STRATA;
+
+    /* the sample must stay well below the whole buffer to be worth it */
+    while (rel_error > 0 && n / strata / 2 >= 4 * MEMCNT_APPROX_BLOCK) {
+        double estimate = 0, variance = 0, hits = 0, scale = 0, err, need;
+        size_t h, k;
+        for (h = 0; h < strata; ++h) {
+            size_t lo = n / strata * h,
+                   hi = h + 1 < strata ? lo + n / strata : n;
+            double x[2], len = (double)(hi - lo);
+            for (k = 0; k < 2; ++k) {
+                size_t half = (hi - lo) / 2, start = lo + k * half;
+                size_t o = start + MEMCNT_APPROX_ALIGN - 1 +
+                           memcnt_approx_rand_(
+                               &seed, half - MEMCNT_APPROX_BLOCK -
+                                          MEMCNT_APPROX_ALIGN + 1);
+                o -= NOT_ALIGNED(p + o, MEMCNT_APPROX_ALIGN);
+                x[k] = (double)memcnt(p + o, c, MEMCNT_APPROX_BLOCK);
+            }
+            /* each block stands for len / 2 bytes of the stratum */
+            estimate += len * (x[0] + x[1]) / (2 * MEMCNT_APPROX_BLOCK);
+            variance += len * len * (x[0] - x[1]) * (x[0] - x[1]) /
+                        (4.0 * MEMCNT_APPROX_BLOCK * MEMCNT_APPROX_BLOCK);
+            hits += x[0] + x[1];
+        }
+
+        /* the bytes found in the sample are themselves a random count; this
+           keeps a sample with no or few matches from looking exact */
+        scale = (double)n / (2.0 * MEMCNT_APPROX_BLOCK * strata);
+        if (variance < scale * scale * (hits + 1))
+            variance = scale * scale * (hits + 1);
+        err = z * memcnt_approx_sqrt_(variance);
+        if (err <= rel_error * estimate) {
+            if (bound)
+                *bound = (size_t)(err + 0.5);
+            return (size_t)(estimate + 0.5);
+        }
+
+        /* the error shrinks with the square root of the sample size */
+        need = err / (rel_error * estimate + 1);
+        need = need * need * 1.2 * (double)strata;
+        if (need > (double)n)
+            break;
+        strata = need > 2.0 * strata ? (size_t)need : 2 * strata;
+    }
+
+    if (bound)
+        *bound = 0;
+    return memcnt(p, c, n);
+}
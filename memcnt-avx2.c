@@ -38,84 +38,93 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "immintrin.h"
 #include <stdint.h>
 
-#ifndef UNROLL
-#define UNROLL 4
+/* _mm_cvtsi128_si64 only exists when compiling for x86-64 */
+#if __amd64__ || __x86_64__ || _WIN64 || _M_X64 || _M_AMD64
+#define AVX2_64 1
 #endif
 
-INLINE size_t avx2_hsum_mm128_epu64(__m128i v) {
+INLINE MEMCNT_TARGET("avx2") size_t avx2_hsum_mm128_epu64(__m128i v) {
     __m128i hi = _mm_shuffle_epi32(v, 78);
+#if AVX2_64
     return (size_t)_mm_cvtsi128_si64(_mm_add_epi64(v, hi));
+#else
+    /* size_t has 32 bits here, so the low half of the sum is enough */
+    return (size_t)(unsigned)_mm_cvtsi128_si32(_mm_add_epi64(v, hi));
+#endif
 }
 
-INLINE size_t avx2_hsum_mm256_epu64(__m256i v) {
+INLINE MEMCNT_TARGET("avx2") size_t avx2_hsum_mm256_epu64(__m256i v) {
     __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
     return avx2_hsum_mm128_epu64(_mm_add_epi64(lo, hi));
 }
 
-MEMCNT_IMPL(avx2)(const void *ptr, int value, size_t num) {
-    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
-    size_t c = 0;
-
-    if (num >= 64) {
-        int k;
-        __m256i cmp = _mm256_set1_epi8((char)v), sums[UNROLL],
-                totals = _mm256_setzero_si256();
-        uint8_t j = 1;
-        const __m256i *wp;
-        while (NOT_ALIGNED(p, 0x20))
-            --num, c += *p++ == v;
-        wp = (const __m256i *)p;
-
-#if UNROLL > 1
-        for (k = 0; k < UNROLL; ++k)
-            sums[k] = _mm256_setzero_si256();
-        while (num >= 0x20 * UNROLL) {
-            __m256i tmp[UNROLL];
-            num -= 0x20 * UNROLL;
-            for (k = 0; k < UNROLL; ++k)
-                tmp[k] = *wp++;
-            for (k = 0; k < UNROLL; ++k)
-                sums[k] =
-                    _mm256_sub_epi8(sums[k], _mm256_cmpeq_epi8(cmp, tmp[k]));
-
-            if (++j == 0) {
-                for (k = 0; k < UNROLL; ++k)
-                    totals = _mm256_add_epi64(
-                        totals,
-                        _mm256_sad_epu8(sums[k], _mm256_setzero_si256()));
-                for (k = 0; k < UNROLL; ++k)
-                    sums[k] = _mm256_setzero_si256();
-                j = 1;
-            }
-        }
-
-        for (k = 0; k < UNROLL; ++k)
-            totals = _mm256_add_epi64(
-                totals, _mm256_sad_epu8(sums[k], _mm256_setzero_si256()));
-        j = 1;
+#define SIMD_NAME avx2
+#define SIMD_VEC __m256i
+#define SIMD_BYTES 0x20
+#define SIMD_TOTAL __m256i
+#define SIMD_ZERO() _mm256_setzero_si256()
+#define SIMD_TOTAL_ZERO() _mm256_setzero_si256()
+#define SIMD_SPLAT(v) _mm256_set1_epi8((char)(v))
+#define SIMD_LOAD(wp) _mm256_load_si256(wp)
+#define SIMD_COUNT(s, c, x) _mm256_sub_epi8(s, _mm256_cmpeq_epi8(c, x))
+#define SIMD_FLUSH_ADD(t, s)                                                   \
+    _mm256_add_epi64(t, _mm256_sad_epu8(s, _mm256_setzero_si256()))
+#define SIMD_HSUM(t) avx2_hsum_mm256_epu64(t)
+#define SIMD_TARGET MEMCNT_TARGET("avx2")
+#ifdef UNROLL
+#define SIMD_UNROLL UNROLL
+#else
+#define SIMD_UNROLL 4
+#endif
+#define SIMD_KEEP (MEMCNT_UTF8 || MEMCNT_EQ2)
+#include "memcnt-simd.h"
+
+#if MEMCNT_UTF8
+/* memcnt_avx2_utf8 (for memcnt-utf8.c) is called with c = 0xBF and
+   counts the bytes greater than it as signed chars (-65), which are those
+   that start a UTF-8 character */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME avx2_utf8
+#define SIMD_COUNT(s, c, x) _mm256_sub_epi8(s, _mm256_cmpgt_epi8(x, c))
+#define SIMD_SCALAR(b, v) MEMCNT_UTF8_LEAD(b)
+#define SIMD_KEEP MEMCNT_EQ2
+#include "memcnt-simd.h"
 #endif
-        sums[0] = _mm256_setzero_si256();
-
-        while (num >= 0x20) {
-            __m256i tmp;
-            num -= 0x20;
-            tmp = *wp++;
-            sums[0] = _mm256_sub_epi8(sums[0], _mm256_cmpeq_epi8(cmp, tmp));
-
-            if (++j == 0) {
-                totals = _mm256_add_epi64(
-                    totals, _mm256_sad_epu8(sums[0], _mm256_setzero_si256()));
-                sums[0] = _mm256_setzero_si256();
-                j = 1;
-            }
-        }
-
-        totals = _mm256_add_epi64(
-            totals, _mm256_sad_epu8(sums[0], _mm256_setzero_si256()));
-        c += avx2_hsum_mm256_epu64(totals);
-        p = (const unsigned char *)wp;
-    }
-    while (num--)
-        c += *p++ == v;
-    return c;
+
+#if MEMCNT_EQ2
+/* memcnt_avx2_eq2 and memcnt_avx2_ham (for memcnt-eq2.c) count the
+   equal bytes and the differing bits of two buffers */
+
+/* the number of bits set in each byte of x, looked up for each nibble */
+INLINE MEMCNT_TARGET("avx2") __m256i avx2_popcnt_epi8_(__m256i x) {
+    __m256i lut = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)),
+            lo = _mm256_set1_epi8(0x0F),
+            hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), lo);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, lo)),
+                           _mm256_shuffle_epi8(lut, hi));
 }
+
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME avx2_eq2
+#define SIMD_LOADU(wp) _mm256_loadu_si256(wp)
+#define SIMD_COUNT(s, y, x) _mm256_sub_epi8(s, _mm256_cmpeq_epi8(y, x))
+#define SIMD_KEEP 1
+#include "memcnt-simd2.h"
+
+/* each byte of the counters grows by up to 8 per iteration */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#undef SIMD_FLUSH
+#define SIMD_NAME avx2_ham
+#define SIMD_COUNT(s, y, x)                                                    \
+    _mm256_add_epi8(s, avx2_popcnt_epi8_(_mm256_xor_si256(x, y)))
+#define SIMD_SCALAR(x, y) MEMCNT_BITS8((x) ^ (y))
+#define SIMD_FLUSH 31
+#include "memcnt-simd2.h"
+#endif
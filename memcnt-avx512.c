@@ -38,76 +38,80 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "immintrin.h"
 #include <stdint.h>
 
-#ifndef UNROLL
-#define UNROLL 1
+#define SIMD_NAME avx512
+#define SIMD_VEC __m512i
+#define SIMD_BYTES 0x40
+#define SIMD_TOTAL __m512i
+#define SIMD_ZERO() _mm512_setzero_si512()
+#define SIMD_TOTAL_ZERO() _mm512_setzero_si512()
+#define SIMD_SPLAT(v) _mm512_set1_epi8((char)(v))
+#define SIMD_LOAD(wp) _mm512_load_si512(wp)
+#define SIMD_COUNT(s, c, x)                                                    \
+    _mm512_mask_add_epi8(s, _mm512_cmpeq_epu8_mask(c, x), s,                   \
+                         _mm512_set1_epi8(1))
+#define SIMD_FLUSH_ADD(t, s)                                                   \
+    _mm512_add_epi64(t, _mm512_sad_epu8(s, _mm512_setzero_si512()))
+#define SIMD_HSUM(t) ((size_t)_mm512_reduce_add_epi64(t))
+#define SIMD_TARGET MEMCNT_TARGET("avx512f,avx512bw")
+#ifdef UNROLL
+#define SIMD_UNROLL UNROLL
+#else
+#define SIMD_UNROLL 4
 #endif
-
-MEMCNT_IMPL(avx512)(const void *ptr, int value, size_t num) {
-    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
-    size_t c = 0;
-
-    if (num >= 128) {
-        int k;
-        __m512i totals = _mm512_setzero_si512();
-        __m512i cmp = _mm512_set1_epi8((char)v), sums[UNROLL],
-                ones = _mm512_set1_epi8(1);
-        uint8_t j = 1;
-        const __m512i *wp;
-        while (NOT_ALIGNED(p, 0x40))
-            --num, c += *p++ == v;
-        wp = (const __m512i *)p;
-        for (k = 0; k < UNROLL; ++k)
-            sums[k] = _mm512_setzero_si512();
-
-#if UNROLL > 1
-        while (num >= 0x40 * UNROLL) {
-            __m512i tmp[UNROLL];
-            __mmask64 masks[UNROLL];
-            num -= 0x40 * UNROLL;
-            for (k = 0; k < UNROLL; ++k)
-                tmp[k] = *wp++;
-            for (k = 0; k < UNROLL; ++k)
-                masks[k] = _mm512_cmpeq_epu8_mask(cmp, tmp[k]);
-            for (k = 0; k < UNROLL; ++k)
-                sums[k] =
-                    _mm512_mask_add_epi8(sums[k], masks[k], sums[k], ones);
-
-            if (++j == 0) {
-                for (k = 0; k < UNROLL; ++k)
-                    totals = _mm512_add_epi64(
-                        totals,
-                        _mm512_sad_epu8(sums[k], _mm512_setzero_si512()));
-                for (k = 0; k < UNROLL; ++k)
-                    sums[k] = _mm512_setzero_si512();
-                j = 1;
-            }
-        }
-
-        for (k = 0; k < UNROLL; ++k)
-            totals = _mm512_add_epi64(
-                totals, _mm512_sad_epu8(sums[k], _mm512_setzero_si512()));
-        sums[0] = _mm512_setzero_si512();
+#define SIMD_KEEP (MEMCNT_UTF8 || MEMCNT_EQ2)
+#include "memcnt-simd.h"
+
+#if MEMCNT_UTF8
+/* memcnt_avx512_utf8 (for memcnt-utf8.c) is called with c = 0xBF and
+   counts the bytes greater than it as signed chars (-65), which are those
+   that start a UTF-8 character */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME avx512_utf8
+#define SIMD_COUNT(s, c, x)                                                    \
+    _mm512_mask_add_epi8(s, _mm512_cmpgt_epi8_mask(x, c), s,                   \
+                         _mm512_set1_epi8(1))
+#define SIMD_SCALAR(b, v) MEMCNT_UTF8_LEAD(b)
+#define SIMD_KEEP MEMCNT_EQ2
+#include "memcnt-simd.h"
 #endif
 
-        while (num >= 0x40) {
-            num -= 0x40;
-            sums[0] = _mm512_mask_add_epi8(
-                sums[0], _mm512_cmpeq_epu8_mask(cmp, *wp++), sums[0], ones);
-
-            if (++j == 0) {
-                totals = _mm512_add_epi64(
-                    totals, _mm512_sad_epu8(sums[0], _mm512_setzero_si512()));
-                sums[0] = _mm512_setzero_si512();
-                j = 1;
-            }
-        }
-
-        totals = _mm512_add_epi64(
-            totals, _mm512_sad_epu8(sums[0], _mm512_setzero_si512()));
-        c += (size_t)_mm512_reduce_add_epi64(totals);
-        p = (const unsigned char *)wp;
-    }
-    while (num--)
-        c += *p++ == v;
-    return c;
+#if MEMCNT_EQ2
+/* memcnt_avx512_eq2 and memcnt_avx512_ham (for memcnt-eq2.c) count the
+   equal bytes and the differing bits of two buffers */
+
+/* the number of bits set in each byte of x, looked up for each nibble */
+INLINE MEMCNT_TARGET("avx512f,avx512bw") __m512i
+avx512_popcnt_epi8_(__m512i x) {
+    __m512i lut = _mm512_broadcast_i32x4(
+                _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)),
+            lo = _mm512_set1_epi8(0x0F),
+            hi = _mm512_and_si512(_mm512_srli_epi16(x, 4), lo);
+    return _mm512_add_epi8(_mm512_shuffle_epi8(lut, _mm512_and_si512(x, lo)),
+                           _mm512_shuffle_epi8(lut, hi));
 }
+
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME avx512_eq2
+#define SIMD_LOADU(wp) _mm512_loadu_si512(wp)
+#define SIMD_COUNT(s, y, x)                                                    \
+    _mm512_mask_add_epi8(s, _mm512_cmpeq_epu8_mask(y, x), s,                   \
+                         _mm512_set1_epi8(1))
+#define SIMD_KEEP 1
+#include "memcnt-simd2.h"
+
+/* each byte of the counters grows by up to 8 per iteration */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#undef SIMD_FLUSH
+#define SIMD_NAME avx512_ham
+#define SIMD_COUNT(s, y, x)                                                    \
+    _mm512_add_epi8(s, avx512_popcnt_epi8_(_mm512_xor_si512(x, y)))
+#define SIMD_SCALAR(x, y) MEMCNT_BITS8((x) ^ (y))
+#define SIMD_FLUSH 31
+#include "memcnt-simd2.h"
+#endif
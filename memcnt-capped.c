@@ -0,0 +1,79 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_capped and memcnt_atleast (for counting only up to a threshold).
+   this file is included by memcnt.c after the memcnt implementations.
+
+   the buffer is counted with memcnt in chunks, and the total is checked
+   between them. a chunk is at least as long as the count still missing from
+   the threshold, since the threshold cannot be reached with fewer bytes, so
+   the threshold costs no extra calls while it is far away. near it, the
+   chunks are MEMCNT_CAPPED_CHUNK bytes; each still spans many iterations of
+   the SIMD loops, so the calls are negligible next to the counting. */
+
+#include "memcnt-impl.h"
+
+#ifndef MEMCNT_CAPPED_CHUNK
+#define MEMCNT_CAPPED_CHUNK 16384
+#endif
+
+size_t memcnt_capped(const void *s, int c, size_t n, size_t cap) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t count = 0;
+    while (n && count < cap) {
+        size_t chunk = cap - count;
+        if (chunk < MEMCNT_CAPPED_CHUNK)
+            chunk = MEMCNT_CAPPED_CHUNK;
+        if (chunk > n)
+            chunk = n;
+        count += memcnt(p, c, chunk);
+        p += chunk, n -= chunk;
+    }
+    return count < cap ? count : cap;
+}
+
+int memcnt_atleast(const void *s, int c, size_t n, size_t k) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t count = 0;
+    /* also stop once the rest of the bytes could not make up the difference */
+    while (count < k && k - count <= n) {
+        size_t chunk = k - count;
+        if (chunk < MEMCNT_CAPPED_CHUNK)
+            chunk = MEMCNT_CAPPED_CHUNK;
+        if (chunk > n)
+            chunk = n;
+        count += memcnt(p, c, chunk);
+        p += chunk, n -= chunk;
+    }
+    return count >= k;
+}
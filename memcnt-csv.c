@@ -0,0 +1,288 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_csv (for counting the delimiters and newlines of CSV text outside
+   quoted fields). this file is included by memcnt.c after the memcnt
+   implementations.
+
+   the SIMD implementations compare 64 bytes at a time and find the quoted
+   bytes with a carry-less multiplication of the quote mask by all ones
+   (PCLMULQDQ on x86, PMULL on ARM), which is its prefix XOR; see
+   memcnt-csv.h. the wide implementation does the same with machine words.
+   the masks themselves are computed by memcnt-mask.c. */
+
+#include "memcnt-impl.h"
+
+#if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
+#define MEMCNT_CSV_DYNAMIC 1
+#else
+#define MEMCNT_CSV_DYNAMIC 0
+#endif
+
+/* one step of the state machine for the byte b: q is 1 inside quotes, c and
+   n count the delimiters (v) and newlines outside them */
+#define MEMCNT_CSV_STEP(b, v, q, c, n)                                         \
+    do {                                                                       \
+        unsigned char b_ = (b);                                                \
+        if (b_ == '"')                                                         \
+            q = !q;                                                            \
+        else if (!q)                                                           \
+            c += b_ == v, n += b_ == '\n';                                     \
+    } while (0)
+
+/* counts the rest of the bytes one at a time and stores the results */
+INLINE size_t memcnt_csv_tail_(const unsigned char *p, unsigned char v,
+                               size_t num, size_t c, size_t n, int q,
+                               size_t *lines, int *quoted) {
+    while (num--)
+        MEMCNT_CSV_STEP(*p++, v, q, c, n);
+    if (lines)
+        *lines = n;
+    *quoted = q;
+    return c;
+}
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_STDINT && !MEMCNT_NAIVE
+
+#if MEMCNT_MASK_X64
+INLINE MEMCNT_TARGET("sse2,pclmul") uint64_t csv_clmul_prefix_xor_(uint64_t x) {
+    __m128i r = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)x),
+                                     _mm_set1_epi8(-1), 0);
+    return (uint64_t)_mm_cvtsi128_si64(r);
+}
+#endif
+
+/* Intel AVX-512(BW) */
+#if MEMCNT_COMPILED_avx512 && MEMCNT_CHECK_pclmul && MEMCNT_MASK_X64
+#define CSV_NAME avx512_csv
+#define CSV_SETUP(v)                                                           \
+    __m512i cq = _mm512_set1_epi8('"'), cd = _mm512_set1_epi8((char)(v)),      \
+            cl = _mm512_set1_epi8('\n');
+#define CSV_MASKS(p, q, d, l)                                                  \
+    do {                                                                       \
+        __m512i x = _mm512_load_si512((const void *)(p));                      \
+        q = _mm512_cmpeq_epi8_mask(x, cq);                                     \
+        d = _mm512_cmpeq_epi8_mask(x, cd);                                     \
+        l = _mm512_cmpeq_epi8_mask(x, cl);                                     \
+    } while (0)
+#define CSV_PREFIX_XOR(x) csv_clmul_prefix_xor_(x)
+#define CSV_POPCOUNT(x) _mm_popcnt_u64(x)
+#define CSV_TARGET MEMCNT_TARGET("avx512f,avx512bw,pclmul,popcnt")
+#include "memcnt-csv.h"
+#ifndef MEMCNT_CSV_PICKED
+#define MEMCNT_CSV_PICKED MEMCNT_NAME(avx512_csv)
+#endif
+#endif
+
+/* Intel AVX2 */
+#if MEMCNT_COMPILED_avx2 && MEMCNT_CHECK_pclmul && MEMCNT_MASK_X64 &&          \
+    (MEMCNT_CSV_DYNAMIC || !defined(MEMCNT_CSV_PICKED))
+#define CSV_NAME avx2_csv
+#define CSV_SETUP(v)                                                           \
+    __m256i cq = _mm256_set1_epi8('"'), cd = _mm256_set1_epi8((char)(v)),      \
+            cl = _mm256_set1_epi8('\n');
+#define CSV_MASKS(p, q, d, l)                                                  \
+    do {                                                                       \
+        __m256i x0 = _mm256_load_si256((const __m256i *)(p)),                  \
+                x1 = _mm256_load_si256((const __m256i *)(p) + 1);              \
+        q = mask64_avx2_(x0, x1, cq);                                          \
+        d = mask64_avx2_(x0, x1, cd);                                          \
+        l = mask64_avx2_(x0, x1, cl);                                          \
+    } while (0)
+#define CSV_PREFIX_XOR(x) csv_clmul_prefix_xor_(x)
+#define CSV_POPCOUNT(x) _mm_popcnt_u64(x)
+#define CSV_TARGET MEMCNT_TARGET("avx2,pclmul,popcnt")
+#include "memcnt-csv.h"
+#ifndef MEMCNT_CSV_PICKED
+#define MEMCNT_CSV_PICKED MEMCNT_NAME(avx2_csv)
+#endif
+#endif
+
+/* Intel SSE2 (with PCLMULQDQ and POPCNT) */
+#if MEMCNT_COMPILED_sse2 && MEMCNT_CHECK_pclmul && MEMCNT_MASK_X64 &&          \
+    (MEMCNT_CSV_DYNAMIC || !defined(MEMCNT_CSV_PICKED))
+#define CSV_NAME sse2_csv
+#define CSV_SETUP(v)                                                           \
+    __m128i cq = _mm_set1_epi8('"'), cd = _mm_set1_epi8((char)(v)),            \
+            cl = _mm_set1_epi8('\n');
+#define CSV_MASKS(p, q, d, l)                                                  \
+    do {                                                                       \
+        const __m128i *xp = (const __m128i *)(p);                              \
+        __m128i x0 = _mm_load_si128(xp), x1 = _mm_load_si128(xp + 1),          \
+                x2 = _mm_load_si128(xp + 2), x3 = _mm_load_si128(xp + 3);      \
+        q = mask64_sse2_(x0, x1, x2, x3, cq);                                  \
+        d = mask64_sse2_(x0, x1, x2, x3, cd);                                  \
+        l = mask64_sse2_(x0, x1, x2, x3, cl);                                  \
+    } while (0)
+#define CSV_PREFIX_XOR(x) csv_clmul_prefix_xor_(x)
+#define CSV_POPCOUNT(x) _mm_popcnt_u64(x)
+#define CSV_TARGET MEMCNT_TARGET("sse2,pclmul,popcnt")
+#include "memcnt-csv.h"
+#ifndef MEMCNT_CSV_PICKED
+#define MEMCNT_CSV_PICKED MEMCNT_NAME(sse2_csv)
+#endif
+#endif
+
+/* ARM Neon (AArch64, with PMULL if the crypto extension is enabled) */
+#if MEMCNT_COMPILED_neon && defined(__aarch64__) &&                            \
+    (MEMCNT_CSV_DYNAMIC || !defined(MEMCNT_CSV_PICKED))
+INLINE uint64_t csv_neon_prefix_xor_(uint64_t x) {
+#if defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+    return (uint64_t)vmull_p64(x, ~(uint64_t)0);
+#else
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    return x ^ x << 32;
+#endif
+}
+
+#define CSV_NAME neon_csv
+#define CSV_SETUP(v)                                                           \
+    uint8x16_t cq = vdupq_n_u8('"'), cd = vdupq_n_u8(v),                       \
+               cl = vdupq_n_u8('\n');
+#define CSV_MASKS(p, q, d, l)                                                  \
+    do {                                                                       \
+        uint8x16_t x[4];                                                       \
+        x[0] = vld1q_u8(p);                                                    \
+        x[1] = vld1q_u8(p + 16);                                               \
+        x[2] = vld1q_u8(p + 32);                                               \
+        x[3] = vld1q_u8(p + 48);                                               \
+        q = mask64_neon_(x, cq);                                               \
+        d = mask64_neon_(x, cd);                                               \
+        l = mask64_neon_(x, cl);                                               \
+    } while (0)
+#define CSV_PREFIX_XOR(x) csv_neon_prefix_xor_(x)
+#define CSV_POPCOUNT(x) vaddv_u8(vcnt_u8(vcreate_u8(x)))
+#include "memcnt-csv.h"
+#ifndef MEMCNT_CSV_PICKED
+#define MEMCNT_CSV_PICKED MEMCNT_NAME(neon_csv)
+#endif
+#endif
+
+#endif
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_WIDE && MEMCNT_WORD == 64 &&                \
+    (MEMCNT_CSV_DYNAMIC || !defined(MEMCNT_CSV_PICKED))
+INLINE uint64_t csv_wide_prefix_xor_(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    return x ^ x << 32;
+}
+
+#define CSV_NAME wide_csv
+#define CSV_SETUP(v)                                                           \
+    memcnt_word_t cq = wide_lo_ * '"', cd = wide_lo_ * (v),                    \
+                  cl = wide_lo_ * '\n';
+#define CSV_MASKS(p, q, d, l)                                                  \
+    do {                                                                       \
+        const memcnt_word_t *wp = (const memcnt_word_t *)(p);                  \
+        q = mask64_wide_(wp, cq);                                              \
+        d = mask64_wide_(wp, cd);                                              \
+        l = mask64_wide_(wp, cl);                                              \
+    } while (0)
+#define CSV_PREFIX_XOR(x) csv_wide_prefix_xor_(x)
+#define CSV_POPCOUNT(x) mask64_popcount_(x)
+#include "memcnt-csv.h"
+#define MEMCNT_CSV_FALLBACK MEMCNT_NAME(wide_csv)
+#ifndef MEMCNT_CSV_PICKED
+#define MEMCNT_CSV_PICKED MEMCNT_NAME(wide_csv)
+#endif
+#endif
+
+#if !defined(MEMCNT_CSV_PICKED) ||                                             \
+    (MEMCNT_CSV_DYNAMIC && !defined(MEMCNT_CSV_FALLBACK))
+static size_t MEMCNT_NAME(default_csv)(const void *ptr, int value,
+                                       size_t num, size_t *lines,
+                                       int *quoted) {
+    return memcnt_csv_tail_((const unsigned char *)ptr, (unsigned char)value,
+                            num, 0, 0, *quoted != 0, lines, quoted);
+}
+#define MEMCNT_CSV_FALLBACK MEMCNT_NAME(default_csv)
+#ifndef MEMCNT_CSV_PICKED
+#define MEMCNT_CSV_PICKED MEMCNT_NAME(default_csv)
+#endif
+#endif
+
+#if MEMCNT_CSV_DYNAMIC
+/* the fallback until memcnt_optimize checks the CPU */
+static size_t (*memcnt_csv_impl_)(const void *, int, size_t, size_t *,
+                                  int *) = &MEMCNT_CSV_FALLBACK;
+
+/* the x86 implementations also need PCLMULQDQ and POPCNT */
+#define MEMCNT_CSV_CANDIDATE(implname, check)                                  \
+    else if (check) memcnt_csv_impl_ = &MEMCNT_NAME(implname##_csv);
+
+/* called by memcnt_optimize */
+static void memcnt_csv_optimize_(void) {
+    if (0)
+        ;
+
+#if MEMCNT_COMPILED_avx512 && MEMCNT_CHECK_pclmul && MEMCNT_MASK_X64 &&        \
+    defined(MEMCNT_DCHECK_avx512) && defined(MEMCNT_DCHECK_pclmul)
+    MEMCNT_CSV_CANDIDATE(avx512, MEMCNT_DCHECK_avx512 && MEMCNT_DCHECK_pclmul)
+#endif
+
+#if MEMCNT_COMPILED_avx2 && MEMCNT_CHECK_pclmul && MEMCNT_MASK_X64 &&          \
+    defined(MEMCNT_DCHECK_avx2) && defined(MEMCNT_DCHECK_pclmul)
+    MEMCNT_CSV_CANDIDATE(avx2, MEMCNT_DCHECK_avx2 && MEMCNT_DCHECK_pclmul)
+#endif
+
+#if MEMCNT_COMPILED_sse2 && MEMCNT_CHECK_pclmul && MEMCNT_MASK_X64 &&          \
+    defined(MEMCNT_DCHECK_sse2) && defined(MEMCNT_DCHECK_pclmul)
+    MEMCNT_CSV_CANDIDATE(sse2, MEMCNT_DCHECK_sse2 && MEMCNT_DCHECK_pclmul)
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(__aarch64__) &&                            \
+    defined(MEMCNT_DCHECK_neon)
+    MEMCNT_CSV_CANDIDATE(neon, MEMCNT_DCHECK_neon)
+#endif
+
+    else
+        memcnt_csv_impl_ = &MEMCNT_CSV_FALLBACK;
+}
+
+#define MEMCNT_CSV_CALL (*memcnt_csv_impl_)
+#else
+#define MEMCNT_CSV_CALL MEMCNT_CSV_PICKED
+#endif
+
+size_t memcnt_csv(const void *s, int c, size_t n, size_t *lines,
+                  int *quoted) {
+    return MEMCNT_CSV_CALL(s, c, n, lines, quoted);
+}
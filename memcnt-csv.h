@@ -0,0 +1,105 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* generic loop for memcnt_csv (see memcnt-csv.c).
+
+   the input is processed in aligned blocks of 64 bytes, for which the
+   implementation computes bit masks of the quotes, delimiters and newlines
+   (bit i for byte i). bit i of the prefix XOR of the quote mask is then the
+   parity of the quotes up to byte i, that is, 1 inside quotes, and the state
+   carried over from the previous block flips the whole block. escaped quotes
+   ("") flip the state twice and so need no special handling.
+
+   like memcnt-simd.h, the implementation defines the parameters below and
+   then includes this file, which undefines them again.
+
+   required:
+      CSV_NAME              name of the implementation
+      CSV_SETUP(v)          declarations (with initializers) of anything
+                              needed by CSV_MASKS, v being the delimiter
+      CSV_MASKS(p, q, d, l) set the uint64_t q, d and l to the masks of the
+                              quotes, delimiters and newlines in the 64 bytes
+                              at p (aligned to 64 bytes)
+      CSV_PREFIX_XOR(x)     the prefix XOR of the uint64_t x
+      CSV_POPCOUNT(x)       the number of bits set in the uint64_t x
+
+   optional:
+      CSV_TARGET            attributes for the function, usually
+                              MEMCNT_TARGET(isa) */
+
+#ifndef MEMCNT_IMPL_H
+#error include memcnt-impl.h before memcnt-csv.h
+#endif
+
+#ifndef CSV_TARGET
+#define CSV_TARGET
+#endif
+
+CSV_TARGET MEMCNT_IMPL(CSV_NAME)(const void *ptr, int value, size_t num,
+                                 size_t *lines, int *quoted) {
+    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
+    size_t c = 0, n = 0;
+    int q = *quoted != 0;
+
+    if (num >= 2 * 64) {
+        CSV_SETUP(v)
+        uint64_t inside;
+        while (NOT_ALIGNED(p, 64)) {
+            --num;
+            MEMCNT_CSV_STEP(*p++, v, q, c, n);
+        }
+        /* all ones inside quotes */
+        inside = 0 - (uint64_t)q;
+
+        while (num >= 64) {
+            uint64_t mq, md, ml, out;
+            CSV_MASKS(p, mq, md, ml);
+            out = ~(CSV_PREFIX_XOR(mq) ^ inside);
+            c += CSV_POPCOUNT(md & out);
+            n += CSV_POPCOUNT(ml & out);
+            /* the state after the last byte, as all zeros or all ones */
+            inside = 0 - (~out >> 63);
+            p += 64;
+            num -= 64;
+        }
+        q = (int)(inside & 1);
+    }
+    return memcnt_csv_tail_(p, v, num, c, n, q, lines, quoted);
+}
+
+#undef CSV_NAME
+#undef CSV_SETUP
+#undef CSV_MASKS
+#undef CSV_PREFIX_XOR
+#undef CSV_POPCOUNT
+#undef CSV_TARGET
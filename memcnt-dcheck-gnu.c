@@ -69,6 +69,17 @@ INLINE int memcnt_dcheck_gnu_avx512_(void) {
 }
 #define MEMCNT_DCHECK_avx512 memcnt_dcheck_gnu_avx512_()
 
+/* PCLMULQDQ and POPCNT, which come with any CPU that has AVX. only
+   memcnt-csv.c checks them, so this may go unused */
+INLINE __attribute__((unused)) int memcnt_dcheck_gnu_pclmul_(void) {
+    if (!called_init_) {
+        __builtin_cpu_init();
+        called_init_ = 1;
+    }
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("popcnt");
+}
+#define MEMCNT_DCHECK_pclmul memcnt_dcheck_gnu_pclmul_()
+
 #endif
 
 #if MEMCNT_ARCH_ARM
@@ -116,9 +127,12 @@ INLINE int memcnt_dcheck_gnu_neon_(void) {
 #endif
 
 #if MEMCNT_ARCH_WASM
+/* a WebAssembly module that contains SIMD instructions fails validation on
+   runtimes without SIMD support, so if a module compiled with SIMD is running
+   at all, SIMD is available. there is no way to test for it from within the
+   module; instead, build one module with and one without SIMD and let the
+   host pick one with memcnt-wasm-probe.js (see README) */
 INLINE int memcnt_dcheck_gnu_wasm_simd_(void) {
-    /* TODO */
-    /* fall time on compile time check */
     return MEMCNT_CHECK_wasm_simd;
 }
 #define MEMCNT_DCHECK_wasm_simd memcnt_dcheck_gnu_wasm_simd_()
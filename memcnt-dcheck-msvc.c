@@ -86,6 +86,20 @@ INLINE int memcnt_dcheck_msvc_sse2_(void) {
 }
 #endif
 
+/* checks that the OS saves the given register state (XCR0 bits) on context
+   switches, which is needed on top of CPU support for AVX and AVX-512 */
+INLINE int memcnt_dcheck_msvc_xcr0_(unsigned mask) {
+#if _M_AMD64
+    int cpuinfo[4];
+    __cpuid(cpuinfo, 1);
+    if (!(cpuinfo[2] & (1 << 27)))
+        return 0;
+    return ((unsigned)_xgetbv(0) & mask) == mask;
+#else
+    return 0;
+#endif
+}
+
 INLINE int memcnt_dcheck_msvc_avx2_(void) {
 #if _M_AMD64
     int cpuinfo[4];
@@ -93,7 +107,7 @@ INLINE int memcnt_dcheck_msvc_avx2_(void) {
     if (cpuinfo[0] < 7)
         return 0;
     __cpuid(cpuinfo, 7);
-    return cpuinfo[1] & (1 << 5);
+    return (cpuinfo[1] & (1 << 5)) && memcnt_dcheck_msvc_xcr0_(0x06);
 #else
     return 0;
 #endif
@@ -107,13 +121,25 @@ INLINE int memcnt_dcheck_msvc_avx512_(void) {
     if (cpuinfo[0] < 7)
         return 0;
     __cpuid(cpuinfo, 7);
-    return cpuinfo[1] & (1 << 30);
+    return (cpuinfo[1] & (1 << 30)) && memcnt_dcheck_msvc_xcr0_(0xE6);
 #else
     return 0;
 #endif
 }
 #define MEMCNT_DCHECK_avx512 memcnt_dcheck_msvc_avx512_()
 
+/* PCLMULQDQ (ECX bit 1) and POPCNT (ECX bit 23) */
+INLINE int memcnt_dcheck_msvc_pclmul_(void) {
+#if _M_AMD64
+    int cpuinfo[4];
+    __cpuid(cpuinfo, 1);
+    return (cpuinfo[2] & (1 << 1)) && (cpuinfo[2] & (1 << 23));
+#else
+    return 0;
+#endif
+}
+#define MEMCNT_DCHECK_pclmul memcnt_dcheck_msvc_pclmul_()
+
 #endif
 
 #if MEMCNT_ARCH_ARM
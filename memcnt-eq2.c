@@ -0,0 +1,219 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_eq2, memcnt_ne2 and memcnt_hamming (for comparing two buffers).
+   this file is included by memcnt.c after the memcnt implementations.
+
+   the SIMD implementations are generated by the memcnt-*.c files from the
+   loop of memcnt with a second input (memcnt-simd2.h): the equal bytes are
+   counted like the bytes equal to a value, and the differing bits by adding
+   the bits set in each byte of the XOR of the two inputs to the same 8-bit
+   counters. */
+
+#include "memcnt-impl.h"
+
+#if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
+#define MEMCNT_EQ2_DYNAMIC 1
+#else
+#define MEMCNT_EQ2_DYNAMIC 0
+#endif
+
+#if MEMCNT_COMPILED_avx512
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(avx512_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(avx512_ham)
+#elif MEMCNT_COMPILED_avx2
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(avx2_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(avx2_ham)
+#elif MEMCNT_COMPILED_sse2
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(sse2_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(sse2_ham)
+#elif MEMCNT_COMPILED_neon
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(neon_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(neon_ham)
+#elif MEMCNT_COMPILED_wasm_simd
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(wasm_simd_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(wasm_simd_ham)
+#endif
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_WIDE &&                                     \
+    (MEMCNT_EQ2_DYNAMIC || !defined(MEMCNT_EQ2_PICKED))
+/* returns a word with the number of bits set in each byte of x */
+INLINE memcnt_word_t wide_bits_(memcnt_word_t x) {
+    x -= (x >> 1) & (memcnt_word_t)(wide_lo_ * 0x55);
+    x = (x & (memcnt_word_t)(wide_lo_ * 0x33)) +
+        ((x >> 2) & (memcnt_word_t)(wide_lo_ * 0x33));
+    return (x + (x >> 4)) & (memcnt_word_t)(wide_lo_ * 0x0F);
+}
+
+/* counts the equal bytes (or the differing bits if ham) like memcnt_wide.
+   the words of q can only be read if it is aligned like p; otherwise, the
+   bytes are compared one at a time */
+INLINE size_t wide_eq2_(const unsigned char *p, const unsigned char *q,
+                        size_t num, int ham) {
+    size_t c = 0;
+    if (num >= MEMCNT_COUNT * 2 &&
+        NOT_ALIGNED(p, MEMCNT_COUNT) == NOT_ALIGNED(q, MEMCNT_COUNT)) {
+        memcnt_word_t sums = 0;
+        /* the bit counts grow by up to 8 per word */
+        unsigned j = 0, flush = ham ? 31 : 255;
+        const memcnt_word_t *wp, *wq;
+        for (; NOT_ALIGNED(p, MEMCNT_COUNT); ++p, ++q)
+            --num, c += ham ? MEMCNT_BITS8(*p ^ *q) : *p == *q;
+        wp = (const memcnt_word_t *)p;
+        wq = (const memcnt_word_t *)q;
+
+        while (num >= MEMCNT_COUNT) {
+            memcnt_word_t x = *wp++ ^ *wq++;
+            num -= MEMCNT_COUNT;
+            sums += ham ? wide_bits_(x) : wide_zeros_(x);
+            if (++j == flush) {
+                c += wide_hsum_(sums);
+                sums = 0;
+                j = 0;
+            }
+        }
+
+        c += wide_hsum_(sums);
+        p = (const unsigned char *)wp;
+        q = (const unsigned char *)wq;
+    }
+    for (; num--; ++p, ++q)
+        c += ham ? MEMCNT_BITS8(*p ^ *q) : *p == *q;
+    return c;
+}
+
+MEMCNT_IMPL(wide_eq2)(const void *ptr, const void *ptr2, size_t num) {
+    return wide_eq2_((const unsigned char *)ptr, (const unsigned char *)ptr2,
+                     num, 0);
+}
+
+MEMCNT_IMPL(wide_ham)(const void *ptr, const void *ptr2, size_t num) {
+    return wide_eq2_((const unsigned char *)ptr, (const unsigned char *)ptr2,
+                     num, 1);
+}
+#define MEMCNT_EQ2_FALLBACK MEMCNT_NAME(wide_eq2)
+#define MEMCNT_HAM_FALLBACK MEMCNT_NAME(wide_ham)
+#ifndef MEMCNT_EQ2_PICKED
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(wide_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(wide_ham)
+#endif
+#endif
+
+#if !defined(MEMCNT_EQ2_PICKED) ||                                             \
+    (MEMCNT_EQ2_DYNAMIC && !defined(MEMCNT_EQ2_FALLBACK))
+/* not MEMCNT_IMPL, which names memcnt itself if it is the only one */
+static size_t MEMCNT_NAME(default_eq2)(const void *ptr, const void *ptr2,
+                                       size_t num) {
+    size_t c = 0;
+    const unsigned char *p = (unsigned char *)ptr, *q = (unsigned char *)ptr2;
+    while (num--)
+        c += *p++ == *q++;
+    return c;
+}
+
+static size_t MEMCNT_NAME(default_ham)(const void *ptr, const void *ptr2,
+                                       size_t num) {
+    size_t c = 0;
+    const unsigned char *p = (unsigned char *)ptr, *q = (unsigned char *)ptr2;
+    for (; num--; ++p, ++q)
+        c += MEMCNT_BITS8(*p ^ *q);
+    return c;
+}
+#define MEMCNT_EQ2_FALLBACK MEMCNT_NAME(default_eq2)
+#define MEMCNT_HAM_FALLBACK MEMCNT_NAME(default_ham)
+#ifndef MEMCNT_EQ2_PICKED
+#define MEMCNT_EQ2_PICKED MEMCNT_NAME(default_eq2)
+#define MEMCNT_HAM_PICKED MEMCNT_NAME(default_ham)
+#endif
+#endif
+
+#if MEMCNT_EQ2_DYNAMIC
+/* the fallbacks until memcnt_optimize checks the CPU */
+static size_t (*memcnt_eq2_impl_)(const void *, const void *, size_t) =
+    &MEMCNT_EQ2_FALLBACK;
+static size_t (*memcnt_ham_impl_)(const void *, const void *, size_t) =
+    &MEMCNT_HAM_FALLBACK;
+
+#define MEMCNT_EQ2_CANDIDATE(implname)                                         \
+    else if (MEMCNT_DCHECK_##implname) memcnt_eq2_impl_ =                      \
+        &MEMCNT_NAME(implname##_eq2),                                          \
+        memcnt_ham_impl_ = &MEMCNT_NAME(implname##_ham);
+
+/* called by memcnt_optimize */
+static void memcnt_eq2_optimize_(void) {
+    if (0)
+        ;
+
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+    MEMCNT_EQ2_CANDIDATE(avx512)
+#endif
+
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+    MEMCNT_EQ2_CANDIDATE(avx2)
+#endif
+
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+    MEMCNT_EQ2_CANDIDATE(sse2)
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(MEMCNT_DCHECK_neon)
+    MEMCNT_EQ2_CANDIDATE(neon)
+#endif
+
+#if MEMCNT_COMPILED_wasm_simd && defined(MEMCNT_DCHECK_wasm_simd)
+    MEMCNT_EQ2_CANDIDATE(wasm_simd)
+#endif
+
+    else
+        memcnt_eq2_impl_ = &MEMCNT_EQ2_FALLBACK,
+        memcnt_ham_impl_ = &MEMCNT_HAM_FALLBACK;
+}
+
+#define MEMCNT_EQ2_CALL (*memcnt_eq2_impl_)
+#define MEMCNT_HAM_CALL (*memcnt_ham_impl_)
+#else
+#define MEMCNT_EQ2_CALL MEMCNT_EQ2_PICKED
+#define MEMCNT_HAM_CALL MEMCNT_HAM_PICKED
+#endif
+
+size_t memcnt_eq2(const void *a, const void *b, size_t n) {
+    return MEMCNT_EQ2_CALL(a, b, n);
+}
+
+size_t memcnt_ne2(const void *a, const void *b, size_t n) {
+    return n - MEMCNT_EQ2_CALL(a, b, n);
+}
+
+size_t memcnt_hamming(const void *a, const void *b, size_t n) {
+    return MEMCNT_HAM_CALL(a, b, n);
+}
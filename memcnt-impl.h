@@ -41,7 +41,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #if !MEMCNT_C
 
 #if MEMCNT_NAMED
-#define MEMCNT_IMPL(arch) size_t memcnt_##arch
+/* indirect so that arch may itself be a macro */
+#define MEMCNT_IMPL_NAME_(arch) memcnt_##arch
+#define MEMCNT_IMPL(arch) size_t MEMCNT_IMPL_NAME_(arch)
 #define MEMCNT_DEFAULT size_t memcnt_default
 #else
 #define MEMCNT_IMPL(arch) size_t memcnt
@@ -61,4 +63,22 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define NOT_ALIGNED(p, m) ((unsigned long)(p) & ((m)-1))
 #endif
 
+/* attribute for compiling a function for an instruction set that is not
+   enabled for the whole file (such as "avx2"). memcnt.c defines this for
+   compilers that support it when using the dynamic dispatcher */
+#ifndef MEMCNT_TARGET
+#define MEMCNT_TARGET(isa)
+#endif
+
+/* 1 if the byte b (an unsigned char) starts a UTF-8 character, that is, is
+   not a continuation byte (0x80-0xBF) */
+#define MEMCNT_UTF8_LEAD(b) (((b) ^ 0x80) >= 0x40)
+
+/* the number of bits set in the byte b (an unsigned char), which is
+   evaluated more than once: first for each pair of bits, then for each
+   nibble, and the multiplication adds the two nibbles in the high one */
+#define MEMCNT_BITS8_2_(b) ((b) - ((b) >> 1 & 0x55))
+#define MEMCNT_BITS8_4_(b) (((b)&0x33) + ((b) >> 2 & 0x33))
+#define MEMCNT_BITS8(b) (MEMCNT_BITS8_4_(MEMCNT_BITS8_2_(b)) * 0x11 >> 4 & 0xF)
+
 #endif /* MEMCNT_IMPL_H */
@@ -0,0 +1,125 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* bit masks of the bytes equal to a value in aligned 64-byte blocks, shared
+   by memcnt-csv.c and memcnt-pattern.c. bit i of a mask is for byte i of the
+   block. this file is included by memcnt.c after the memcnt implementations;
+   the helpers for an instruction set are only defined if its memcnt
+   implementation is compiled in. */
+
+#include "memcnt-impl.h"
+
+/* memcnt-wide.c may be compiled in without MEMCNT_STDINT (such as in C++,
+   where <cstdint> has been included), so this only needs uint64_t */
+#if MEMCNT_CAN_MULTIARCH
+
+INLINE unsigned mask64_popcount_(uint64_t x) {
+    x -= (x >> 1) & UINT64_C(0x5555555555555555);
+    x = (x & UINT64_C(0x3333333333333333)) +
+        ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    return (unsigned)((x * UINT64_C(0x0101010101010101)) >> 56);
+}
+
+/* the index of the lowest set bit of x, which must not be zero */
+INLINE unsigned mask64_ctz_(uint64_t x) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    return mask64_popcount_((x & (0 - x)) - 1);
+#endif
+}
+
+#if !MEMCNT_NAIVE
+
+#if MEMCNT_ARCH_X86 && (__amd64__ || __x86_64__ || _M_X64 || _M_AMD64)
+#include <immintrin.h>
+#define MEMCNT_MASK_X64 1
+#endif
+
+#if MEMCNT_COMPILED_avx2
+INLINE MEMCNT_TARGET("avx2") uint64_t mask64_avx2_(__m256i x0, __m256i x1,
+                                                   __m256i c) {
+    uint32_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0, c));
+    uint32_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1, c));
+    return lo | (uint64_t)hi << 32;
+}
+#endif
+
+#if MEMCNT_COMPILED_sse2
+INLINE MEMCNT_TARGET("sse2") uint64_t mask64_sse2_(__m128i x0, __m128i x1,
+                                                   __m128i x2, __m128i x3,
+                                                   __m128i c) {
+    uint64_t m0 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x0, c));
+    uint64_t m1 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x1, c));
+    uint64_t m2 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x2, c));
+    uint64_t m3 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x3, c));
+    return m0 | m1 << 16 | m2 << 32 | m3 << 48;
+}
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(__aarch64__)
+INLINE uint64_t mask64_neon_(const uint8x16_t *x, uint8x16_t c) {
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                     1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t b = vld1q_u8(bits);
+    uint8x16_t m0 = vandq_u8(vceqq_u8(x[0], c), b);
+    uint8x16_t m1 = vandq_u8(vceqq_u8(x[1], c), b);
+    uint8x16_t m2 = vandq_u8(vceqq_u8(x[2], c), b);
+    uint8x16_t m3 = vandq_u8(vceqq_u8(x[3], c), b);
+    /* three rounds of pairwise additions gather the bits of each 8 bytes */
+    m0 = vpaddq_u8(vpaddq_u8(m0, m1), vpaddq_u8(m2, m3));
+    m0 = vpaddq_u8(m0, m0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(m0), 0);
+}
+#endif
+
+#endif
+
+/* finds the bytes equal to a value in each word like memcnt_wide, and
+   gathers the 01 bytes into a bit mask with a multiplication: the bit of
+   byte k is shifted to bit 56 + k by the factor byte 7 - k, and no two
+   products overlap */
+#if MEMCNT_WIDE && MEMCNT_WORD == 64
+INLINE uint64_t mask64_wide_(const memcnt_word_t *wp, memcnt_word_t c) {
+    uint64_t m = 0;
+    int k;
+    for (k = 0; k < 8; ++k) {
+        memcnt_word_t z = wide_zeros_(wp[k] ^ c);
+        m |= (uint64_t)(z * UINT64_C(0x0102040810204080) >> 56) << (k * 8);
+    }
+    return m;
+}
+#endif
+
+#endif
@@ -38,41 +38,65 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <arm_neon.h>
 #include <stdint.h>
 
-INLINE unsigned neon_hsum_u8x16_u(uint8x16_t v) {
-    int i;
-    unsigned s = 0;
-    for (i = 0; i < 16; ++i)
-        s += v[i];
-    return s;
+INLINE size_t neon_hsum_u64x2(uint64x2_t v) {
+    return (size_t)(vgetq_lane_u64(v, 0) + vgetq_lane_u64(v, 1));
 }
 
-MEMCNT_IMPL(neon)(const void *ptr, int value, size_t num) {
-    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
-    size_t c = 0;
-
-    if (num >= 32) {
-        uint8x16_t cmp = vdupq_n_u8((uint8_t)v), sums = vdupq_n_u8(0);
-        uint8_t j = 1;
-        const uint8x16_t *wp;
-        while (NOT_ALIGNED(p, 0x10))
-            --num, c += *p++ == v;
-        wp = (const uint8x16_t *)p;
-
-        while (num >= 0x10) {
-            num -= 0x10;
-            sums = vsubq_u8(sums, vceqq_u8(cmp, *wp++));
-
-            if (++j == 0) {
-                c += neon_hsum_u8x16_u(sums);
-                sums = vdupq_n_u8(0);
-                j = 1;
-            }
-        }
-
-        c += neon_hsum_u8x16_u(sums);
-        p = (const unsigned char *)wp;
-    }
-    while (num--)
-        c += *p++ == v;
-    return c;
-}
+/* pairwise widening adds from 8 to 64 bits, the last one accumulating */
+#define SIMD_NAME neon
+#define SIMD_VEC uint8x16_t
+#define SIMD_BYTES 0x10
+#define SIMD_TOTAL uint64x2_t
+#define SIMD_ZERO() vdupq_n_u8(0)
+#define SIMD_TOTAL_ZERO() vdupq_n_u64(0)
+#define SIMD_SPLAT(v) vdupq_n_u8((uint8_t)(v))
+#define SIMD_LOAD(wp) vld1q_u8((const uint8_t *)(wp))
+#define SIMD_COUNT(s, c, x) vsubq_u8(s, vceqq_u8(c, x))
+#define SIMD_FLUSH_ADD(t, s) vpadalq_u32(t, vpaddlq_u16(vpaddlq_u8(s)))
+#define SIMD_HSUM(t) neon_hsum_u64x2(t)
+#ifdef UNROLL
+#define SIMD_UNROLL UNROLL
+#else
+#define SIMD_UNROLL 4
+#endif
+#define SIMD_KEEP (MEMCNT_UTF8 || MEMCNT_EQ2)
+#include "memcnt-simd.h"
+
+#if MEMCNT_UTF8
+/* memcnt_neon_utf8 (for memcnt-utf8.c) is called with c = 0xBF and
+   counts the bytes greater than it as signed chars (-65), which are those
+   that start a UTF-8 character */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME neon_utf8
+#define SIMD_COUNT(s, c, x)                                                    \
+    vsubq_u8(s, vcgtq_s8(vreinterpretq_s8_u8(x), vreinterpretq_s8_u8(c)))
+#define SIMD_SCALAR(b, v) MEMCNT_UTF8_LEAD(b)
+#define SIMD_KEEP MEMCNT_EQ2
+#include "memcnt-simd.h"
+#endif
+
+#if MEMCNT_EQ2
+/* memcnt_neon_eq2 and memcnt_neon_ham (for memcnt-eq2.c) count the
+   equal bytes and the differing bits of two buffers */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME neon_eq2
+#define SIMD_LOADU(wp) vld1q_u8((const uint8_t *)(wp))
+#define SIMD_COUNT(s, y, x) vsubq_u8(s, vceqq_u8(y, x))
+#define SIMD_KEEP 1
+#include "memcnt-simd2.h"
+
+/* each byte of the counters grows by up to 8 per iteration */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#undef SIMD_FLUSH
+#define SIMD_NAME neon_ham
+#define SIMD_COUNT(s, y, x) vaddq_u8(s, vcntq_u8(veorq_u8(x, y)))
+#define SIMD_SCALAR(x, y) MEMCNT_BITS8((x) ^ (y))
+#define SIMD_FLUSH 31
+#include "memcnt-simd2.h"
+#endif
@@ -0,0 +1,343 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_pattern and friends (for counting the occurrences of a short byte
+   string). this file is included by memcnt.c after the memcnt
+   implementations.
+
+   the SIMD and wide implementations compare the first and last bytes of the
+   pattern with 64 bytes at a time and only check the rest of the pattern at
+   the candidates that remain; see memcnt-pattern.h. the masks themselves are
+   computed by memcnt-mask.c. patterns of one byte are counted by memcnt. */
+
+#include "memcnt-impl.h"
+
+#if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
+#define MEMCNT_PATTERN_DYNAMIC 1
+#else
+#define MEMCNT_PATTERN_DYNAMIC 0
+#endif
+
+/* whether the len bytes at p are equal to pat */
+INLINE int memcnt_pattern_at_(const unsigned char *p,
+                              const unsigned char *pat, size_t len) {
+    size_t i;
+    for (i = 0; i < len; ++i)
+        if (p[i] != pat[i])
+            return 0;
+    return 1;
+}
+
+/* counts the matches that start between i and end and fit within num bytes,
+   skipping those that start before *from. if disjoint, *from is moved to the
+   end of each match counted */
+INLINE size_t memcnt_pattern_scan_(const unsigned char *p, size_t i,
+                                   size_t end, size_t num,
+                                   const unsigned char *pat, size_t len,
+                                   size_t *from, int disjoint) {
+    size_t c = 0;
+    for (; i < end && i + len <= num; ++i)
+        if (i >= *from && memcnt_pattern_at_(p + i, pat, len)) {
+            ++c;
+            if (disjoint)
+                *from = i + len;
+        }
+    return c;
+}
+
+/* whether two matches of the pattern can overlap, that is, whether a proper
+   prefix of it is also a suffix (as in "aa" or "abab"). if not, counting the
+   disjoint matches is the same as counting all of them */
+INLINE int memcnt_pattern_overlaps_(const unsigned char *pat, size_t len) {
+    size_t k;
+    for (k = 1; k < len; ++k)
+        if (memcnt_pattern_at_(pat + k, pat, len - k))
+            return 1;
+    return 0;
+}
+
+/* the implementations count the matches of the pattern (2 to 8 bytes) in the
+   num bytes at ptr. next is null to count all matches; otherwise, only
+   matches starting at or after *next are counted, none of them overlapping,
+   and *next is set to the end of the last one (or left alone if none) */
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_STDINT && !MEMCNT_NAIVE
+
+/* Intel AVX-512(BW) */
+#if MEMCNT_COMPILED_avx512
+#define PAT_NAME avx512_pattern
+#define PAT_SETUP(f, l)                                                        \
+    __m512i cf = _mm512_set1_epi8((char)(f)), cl = _mm512_set1_epi8((char)(l));
+#define PAT_MASKS(p, mf, ml)                                                   \
+    do {                                                                       \
+        __m512i x = _mm512_load_si512((const void *)(p));                      \
+        mf = _mm512_cmpeq_epi8_mask(x, cf);                                    \
+        ml = _mm512_cmpeq_epi8_mask(x, cl);                                    \
+    } while (0)
+#define PAT_POPCOUNT(x) mask64_popcount_(x)
+#define PAT_TARGET MEMCNT_TARGET("avx512f,avx512bw")
+#include "memcnt-pattern.h"
+#ifndef MEMCNT_PATTERN_PICKED
+#define MEMCNT_PATTERN_PICKED MEMCNT_NAME(avx512_pattern)
+#endif
+#endif
+
+/* Intel AVX2 */
+#if MEMCNT_COMPILED_avx2 &&                                                    \
+    (MEMCNT_PATTERN_DYNAMIC || !defined(MEMCNT_PATTERN_PICKED))
+#define PAT_NAME avx2_pattern
+#define PAT_SETUP(f, l)                                                        \
+    __m256i cf = _mm256_set1_epi8((char)(f)), cl = _mm256_set1_epi8((char)(l));
+#define PAT_MASKS(p, mf, ml)                                                   \
+    do {                                                                       \
+        __m256i x0 = _mm256_load_si256((const __m256i *)(p)),                  \
+                x1 = _mm256_load_si256((const __m256i *)(p) + 1);              \
+        mf = mask64_avx2_(x0, x1, cf);                                         \
+        ml = mask64_avx2_(x0, x1, cl);                                         \
+    } while (0)
+#define PAT_POPCOUNT(x) mask64_popcount_(x)
+#define PAT_TARGET MEMCNT_TARGET("avx2")
+#include "memcnt-pattern.h"
+#ifndef MEMCNT_PATTERN_PICKED
+#define MEMCNT_PATTERN_PICKED MEMCNT_NAME(avx2_pattern)
+#endif
+#endif
+
+/* Intel SSE2 */
+#if MEMCNT_COMPILED_sse2 &&                                                    \
+    (MEMCNT_PATTERN_DYNAMIC || !defined(MEMCNT_PATTERN_PICKED))
+#define PAT_NAME sse2_pattern
+#define PAT_SETUP(f, l)                                                        \
+    __m128i cf = _mm_set1_epi8((char)(f)), cl = _mm_set1_epi8((char)(l));
+#define PAT_MASKS(p, mf, ml)                                                   \
+    do {                                                                       \
+        const __m128i *xp = (const __m128i *)(p);                              \
+        __m128i x0 = _mm_load_si128(xp), x1 = _mm_load_si128(xp + 1),          \
+                x2 = _mm_load_si128(xp + 2), x3 = _mm_load_si128(xp + 3);      \
+        mf = mask64_sse2_(x0, x1, x2, x3, cf);                                 \
+        ml = mask64_sse2_(x0, x1, x2, x3, cl);                                 \
+    } while (0)
+#define PAT_POPCOUNT(x) mask64_popcount_(x)
+#define PAT_TARGET MEMCNT_TARGET("sse2")
+#include "memcnt-pattern.h"
+#ifndef MEMCNT_PATTERN_PICKED
+#define MEMCNT_PATTERN_PICKED MEMCNT_NAME(sse2_pattern)
+#endif
+#endif
+
+/* ARM Neon (AArch64) */
+#if MEMCNT_COMPILED_neon && defined(__aarch64__) &&                            \
+    (MEMCNT_PATTERN_DYNAMIC || !defined(MEMCNT_PATTERN_PICKED))
+#define PAT_NAME neon_pattern
+#define PAT_SETUP(f, l) uint8x16_t cf = vdupq_n_u8(f), cl = vdupq_n_u8(l);
+#define PAT_MASKS(p, mf, ml)                                                   \
+    do {                                                                       \
+        uint8x16_t x[4];                                                       \
+        x[0] = vld1q_u8(p);                                                    \
+        x[1] = vld1q_u8(p + 16);                                               \
+        x[2] = vld1q_u8(p + 32);                                               \
+        x[3] = vld1q_u8(p + 48);                                               \
+        mf = mask64_neon_(x, cf);                                              \
+        ml = mask64_neon_(x, cl);                                              \
+    } while (0)
+#define PAT_POPCOUNT(x) vaddv_u8(vcnt_u8(vcreate_u8(x)))
+#include "memcnt-pattern.h"
+#ifndef MEMCNT_PATTERN_PICKED
+#define MEMCNT_PATTERN_PICKED MEMCNT_NAME(neon_pattern)
+#endif
+#endif
+
+#endif
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_WIDE && MEMCNT_WORD == 64 &&                \
+    (MEMCNT_PATTERN_DYNAMIC || !defined(MEMCNT_PATTERN_PICKED))
+#define PAT_NAME wide_pattern
+#define PAT_SETUP(f, l) memcnt_word_t cf = wide_lo_ * (f), cl = wide_lo_ * (l);
+#define PAT_MASKS(p, mf, ml)                                                   \
+    do {                                                                       \
+        const memcnt_word_t *wp = (const memcnt_word_t *)(p);                  \
+        mf = mask64_wide_(wp, cf);                                             \
+        ml = mask64_wide_(wp, cl);                                             \
+    } while (0)
+#define PAT_POPCOUNT(x) mask64_popcount_(x)
+#include "memcnt-pattern.h"
+#define MEMCNT_PATTERN_FALLBACK MEMCNT_NAME(wide_pattern)
+#ifndef MEMCNT_PATTERN_PICKED
+#define MEMCNT_PATTERN_PICKED MEMCNT_NAME(wide_pattern)
+#endif
+#endif
+
+#if !defined(MEMCNT_PATTERN_PICKED) ||                                         \
+    (MEMCNT_PATTERN_DYNAMIC && !defined(MEMCNT_PATTERN_FALLBACK))
+static size_t MEMCNT_NAME(default_pattern)(const void *ptr, size_t num,
+                                           const unsigned char *pat,
+                                           size_t len, size_t *next) {
+    size_t from = next ? *next : 0;
+    size_t c = memcnt_pattern_scan_((const unsigned char *)ptr, 0, num, num,
+                                    pat, len, &from, next != 0);
+    if (next)
+        *next = from;
+    return c;
+}
+#define MEMCNT_PATTERN_FALLBACK MEMCNT_NAME(default_pattern)
+#ifndef MEMCNT_PATTERN_PICKED
+#define MEMCNT_PATTERN_PICKED MEMCNT_NAME(default_pattern)
+#endif
+#endif
+
+#if MEMCNT_PATTERN_DYNAMIC
+/* the fallback until memcnt_optimize checks the CPU */
+static size_t (*memcnt_pattern_impl_)(const void *, size_t,
+                                      const unsigned char *, size_t,
+                                      size_t *) = &MEMCNT_PATTERN_FALLBACK;
+
+#define MEMCNT_PATTERN_CANDIDATE(implname)                                     \
+    else if (MEMCNT_DCHECK_##implname) memcnt_pattern_impl_ =                  \
+        &MEMCNT_NAME(implname##_pattern);
+
+/* called by memcnt_optimize */
+static void memcnt_pattern_optimize_(void) {
+    if (0)
+        ;
+
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+    MEMCNT_PATTERN_CANDIDATE(avx512)
+#endif
+
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+    MEMCNT_PATTERN_CANDIDATE(avx2)
+#endif
+
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+    MEMCNT_PATTERN_CANDIDATE(sse2)
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(__aarch64__) &&                            \
+    defined(MEMCNT_DCHECK_neon)
+    MEMCNT_PATTERN_CANDIDATE(neon)
+#endif
+
+    else
+        memcnt_pattern_impl_ = &MEMCNT_PATTERN_FALLBACK;
+}
+
+#define MEMCNT_PATTERN_CALL (*memcnt_pattern_impl_)
+#else
+#define MEMCNT_PATTERN_CALL MEMCNT_PATTERN_PICKED
+#endif
+
+size_t memcnt_pattern(const void *s, size_t n, const void *pat,
+                      size_t patlen) {
+    if (patlen == 1)
+        return memcnt(s, *(const unsigned char *)pat, n);
+    if (patlen < 1 || patlen > MEMCNT_PATTERN_MAX)
+        return 0;
+    return MEMCNT_PATTERN_CALL(s, n, (const unsigned char *)pat, patlen, 0);
+}
+
+size_t memcnt_pattern_disjoint(const void *s, size_t n, const void *pat,
+                               size_t patlen) {
+    const unsigned char *pp = (const unsigned char *)pat;
+    size_t next = 0;
+    if (patlen == 1)
+        return memcnt(s, *pp, n);
+    if (patlen < 1 || patlen > MEMCNT_PATTERN_MAX)
+        return 0;
+    return MEMCNT_PATTERN_CALL(
+        s, n, pp, patlen, memcnt_pattern_overlaps_(pp, patlen) ? &next : 0);
+}
+
+void memcnt_pattern_begin(struct memcnt_pattern_state *st, const void *pat,
+                          size_t patlen, int disjoint) {
+    const unsigned char *pp = (const unsigned char *)pat;
+    size_t i;
+    if (patlen > MEMCNT_PATTERN_MAX)
+        patlen = 0;
+    for (i = 0; i < patlen; ++i)
+        st->pat[i] = pp[i];
+    st->len = (unsigned char)patlen;
+    st->nheld = st->skip = 0;
+    /* only patterns that can overlap need to track where the last match
+       ended */
+    st->disjoint = disjoint && memcnt_pattern_overlaps_(pp, patlen);
+}
+
+size_t memcnt_pattern_next(struct memcnt_pattern_state *st, const void *s,
+                           size_t n) {
+    const unsigned char *p = (const unsigned char *)s;
+    unsigned char join[2 * MEMCNT_PATTERN_MAX - 2];
+    size_t len = st->len, h = st->nheld, c = 0, next = 0, nj, keep, skip, j;
+    if (len <= 1)
+        return len ? memcnt(p, st->pat[0], n) : 0;
+
+    /* the matches that start in the bytes held from the previous chunks and
+       end in this one */
+    nj = h + (n < len - 1 ? n : len - 1);
+    for (j = 0; j < h; ++j)
+        join[j] = st->held[j];
+    for (; j < nj; ++j)
+        join[j] = p[j - h];
+    for (j = st->skip; j < h && j + len <= nj; ++j)
+        if (memcnt_pattern_at_(join + j, st->pat, len)) {
+            ++c;
+            if (st->disjoint) {
+                next = j + len - h;
+                j += len - 1;
+            }
+        }
+
+    c += MEMCNT_PATTERN_CALL(p, n, st->pat, len, st->disjoint ? &next : 0);
+
+    /* hold the last len - 1 bytes (fewer at the start), and skip the ones
+       that are part of the last match in disjoint mode */
+    keep = h + n < len - 1 ? h + n : len - 1;
+    skip = 0;
+    if (st->disjoint) {
+        if (next && next + keep > n)
+            skip = next + keep - n;
+        if (st->skip + keep > h + n && st->skip + keep - (h + n) > skip)
+            skip = st->skip + keep - (h + n);
+    }
+    if (n >= keep) {
+        for (j = 0; j < keep; ++j)
+            st->held[j] = p[n - keep + j];
+    } else {
+        for (j = 0; j < keep - n; ++j)
+            st->held[j] = st->held[h - (keep - n) + j];
+        for (; j < keep; ++j)
+            st->held[j] = p[j - (keep - n)];
+    }
+    st->nheld = (unsigned char)keep;
+    st->skip = (unsigned char)skip;
+    return c;
+}
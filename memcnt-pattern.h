@@ -0,0 +1,115 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* generic loop for memcnt_pattern (see memcnt-pattern.c).
+
+   the candidates for a match are found 64 at a time: byte i is a candidate
+   if it is equal to the first byte of the pattern and byte i + len - 1 to the
+   last. the implementation computes the masks of both in aligned blocks of 64
+   bytes, and the mask of the last byte is shifted down by len - 1 bits,
+   taking the missing bits from the next block. only the candidates are then
+   compared in full (and if the pattern has two bytes, not even them).
+
+   like memcnt-simd.h, the implementation defines the parameters below and
+   then includes this file, which undefines them again.
+
+   required:
+      PAT_NAME              name of the implementation
+      PAT_SETUP(f, l)       declarations (with initializers) of anything
+                              needed by PAT_MASKS, f and l being the first
+                              and last bytes of the pattern
+      PAT_MASKS(p, mf, ml)  set the uint64_t mf and ml to the masks of the
+                              bytes equal to the first and the last byte of
+                              the pattern in the 64 bytes at p (aligned to
+                              64 bytes)
+      PAT_POPCOUNT(x)       the number of bits set in the uint64_t x
+
+   optional:
+      PAT_TARGET            attributes for the function, usually
+                              MEMCNT_TARGET(isa) */
+
+#ifndef MEMCNT_IMPL_H
+#error include memcnt-impl.h before memcnt-pattern.h
+#endif
+
+#ifndef PAT_TARGET
+#define PAT_TARGET
+#endif
+
+PAT_TARGET MEMCNT_IMPL(PAT_NAME)(const void *ptr, size_t num,
+                                 const unsigned char *pat, size_t len,
+                                 size_t *next) {
+    const unsigned char *p = (unsigned char *)ptr;
+    size_t c = 0, i = 0, from = next ? *next : 0;
+
+    if (num >= len + 3 * 64) {
+        unsigned s = (unsigned)len - 1;
+        uint64_t mf, ml;
+        PAT_SETUP(pat[0], pat[len - 1])
+        if (NOT_ALIGNED(p, 64))
+            i = 64 - NOT_ALIGNED(p, 64);
+        c = memcnt_pattern_scan_(p, 0, i, num, pat, len, &from, next != 0);
+        PAT_MASKS(p + i, mf, ml);
+
+        /* the block at i is counted once the next one is loaded */
+        while (num - i >= 2 * 64) {
+            uint64_t nf, nl, cand;
+            PAT_MASKS(p + i + 64, nf, nl);
+            cand = mf & (ml >> s | nl << (64 - s));
+            if (len == 2 && !next)
+                c += PAT_POPCOUNT(cand);
+            else
+                while (cand) {
+                    size_t at = i + mask64_ctz_(cand);
+                    cand &= cand - 1;
+                    if (at >= from && memcnt_pattern_at_(p + at, pat, len)) {
+                        ++c;
+                        if (next)
+                            from = at + len;
+                    }
+                }
+            mf = nf, ml = nl;
+            i += 64;
+        }
+    }
+    c += memcnt_pattern_scan_(p, i, num, num, pat, len, &from, next != 0);
+    if (next)
+        *next = from;
+    return c;
+}
+
+#undef PAT_NAME
+#undef PAT_SETUP
+#undef PAT_MASKS
+#undef PAT_POPCOUNT
+#undef PAT_TARGET
@@ -0,0 +1,262 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_rank_* (an index for counting a value before any offset of a
+   buffer that is being edited). this file is included by memcnt.c after the
+   memcnt implementations.
+
+   the buffer is split into blocks of about MEMCNT_RANK_BLOCK bytes, and the
+   lengths and counts of the blocks are kept in two Fenwick trees. the tree
+   of lengths finds the block that contains an offset, and the tree of counts
+   sums up the blocks before it, both in O(log n); the rest is counted with
+   memcnt within the block. an edit only changes the length of the blocks it
+   touches and recounts them. when a block has grown too long or the blocks
+   have become too short on average, the blocks are split and merged again
+   in one pass, which only recounts the blocks that are split. */
+
+#include "memcnt-impl.h"
+
+#include <stdlib.h>
+
+#ifndef MEMCNT_RANK_BLOCK
+#define MEMCNT_RANK_BLOCK 4096
+#endif
+
+struct memcnt_rank {
+    /* the number of blocks, and the number of bytes in all of them */
+    size_t nb, total;
+    /* the lengths and counts of the blocks, and their Fenwick trees (whose
+       element i, from 1 to nb, covers the blocks i - (i & -i) to i - 1) */
+    size_t *len, *cnt, *flen, *fcnt;
+    unsigned char c;
+};
+
+INLINE void memcnt_rank_add_(size_t *tree, size_t nb, size_t i,
+                             size_t delta) {
+    /* delta may have wrapped around to subtract */
+    for (++i; i <= nb; i += i & (0 - i))
+        tree[i] += delta;
+}
+
+/* the sum of the first i elements */
+INLINE size_t memcnt_rank_sum_(const size_t *tree, size_t i) {
+    size_t s = 0;
+    for (; i; i -= i & (0 - i))
+        s += tree[i];
+    return s;
+}
+
+/* finds the block that contains the offset pos and stores the offset of the
+   block into *start. past the end, returns nb */
+INLINE size_t memcnt_rank_find_(const struct memcnt_rank *r, size_t pos,
+                                size_t *start) {
+    size_t i = 0, step = 1;
+    while (step <= r->nb / 2)
+        step *= 2;
+    *start = 0;
+    for (; step; step /= 2)
+        if (i + step <= r->nb && r->flen[i + step] <= pos - *start)
+            i += step, *start += r->flen[i];
+    return i;
+}
+
+/* sets the count of block i by counting it anew */
+INLINE void memcnt_rank_recount_(struct memcnt_rank *r, const void *s,
+                                 size_t i, size_t start) {
+    size_t n = memcnt((const unsigned char *)s + start, r->c, r->len[i]);
+    memcnt_rank_add_(r->fcnt, r->nb, i, n - r->cnt[i]);
+    r->cnt[i] = n;
+}
+
+/* allocates the arrays for nb blocks into r */
+static int memcnt_rank_alloc_(struct memcnt_rank *r, size_t nb) {
+    size_t *a = (size_t *)malloc(4 * (nb + 1) * sizeof(size_t));
+    if (!a)
+        return -1;
+    r->nb = nb;
+    r->len = a, r->cnt = a + nb + 1;
+    r->flen = a + 2 * (nb + 1), r->fcnt = a + 3 * (nb + 1);
+    return 0;
+}
+
+/* builds the Fenwick trees from the lengths and counts in O(nb) */
+static void memcnt_rank_build_(struct memcnt_rank *r) {
+    size_t i, j;
+    r->flen[0] = r->fcnt[0] = 0;
+    for (i = 1; i <= r->nb; ++i)
+        r->flen[i] = r->len[i - 1], r->fcnt[i] = r->cnt[i - 1];
+    for (i = 1; i <= r->nb; ++i)
+        if ((j = i + (i & (0 - i))) <= r->nb)
+            r->flen[j] += r->flen[i], r->fcnt[j] += r->fcnt[i];
+}
+
+/* splits the blocks longer than 2 * MEMCNT_RANK_BLOCK (and the block dirty,
+   whose count is not known), and merges the short ones with their
+   neighbors. if there is no memory for this, only recounts dirty */
+static void memcnt_rank_rebalance_(struct memcnt_rank *r, const void *s,
+                                   size_t dirty) {
+    const unsigned char *p = (const unsigned char *)s;
+    struct memcnt_rank o = *r;
+    size_t i, k, pos, nb = 0;
+
+    /* an upper bound of the new number of blocks */
+    for (i = 0; i < o.nb; ++i)
+        nb += o.len[i] / MEMCNT_RANK_BLOCK + 1;
+    if (memcnt_rank_alloc_(r, nb)) {
+        *r = o;
+        if (dirty < o.nb)
+            memcnt_rank_recount_(r, s, dirty, memcnt_rank_sum_(o.flen, dirty));
+        return;
+    }
+
+    nb = 0;
+    for (i = 0, pos = 0; i < o.nb; pos += o.len[i++]) {
+        if (i == dirty || o.len[i] > 2 * MEMCNT_RANK_BLOCK) {
+            /* pieces of one block, the last one up to 1.5 blocks long */
+            for (k = 0; k < o.len[i]; k += r->len[nb++]) {
+                r->len[nb] = o.len[i] - k;
+                if (r->len[nb] >= MEMCNT_RANK_BLOCK * 3 / 2)
+                    r->len[nb] = MEMCNT_RANK_BLOCK;
+                r->cnt[nb] = memcnt(p + pos + k, r->c, r->len[nb]);
+            }
+        } else if (nb && r->len[nb - 1] + o.len[i] <= MEMCNT_RANK_BLOCK) {
+            r->len[nb - 1] += o.len[i];
+            r->cnt[nb - 1] += o.cnt[i];
+        } else if (o.len[i]) {
+            r->len[nb] = o.len[i];
+            r->cnt[nb++] = o.cnt[i];
+        }
+    }
+    /* there is always at least one block, even if empty */
+    if (!nb)
+        r->len[0] = r->cnt[0] = 0, nb = 1;
+    r->nb = nb;
+    memcnt_rank_build_(r);
+    free(o.len);
+}
+
+struct memcnt_rank *memcnt_rank_new(const void *s, size_t n, int c) {
+    struct memcnt_rank *r =
+        (struct memcnt_rank *)malloc(sizeof(struct memcnt_rank));
+    if (!r)
+        return NULL;
+    r->c = (unsigned char)c;
+    r->total = n;
+    if (memcnt_rank_alloc_(r, 1)) {
+        free(r);
+        return NULL;
+    }
+    /* one block of all of it, split up by memcnt_rank_rebalance_ */
+    r->len[0] = n;
+    r->cnt[0] = 0;
+    memcnt_rank_build_(r);
+    memcnt_rank_rebalance_(r, s, 0);
+    return r;
+}
+
+void memcnt_rank_free(struct memcnt_rank *r) {
+    if (r) {
+        free(r->len);
+        free(r);
+    }
+}
+
+size_t memcnt_rank(const struct memcnt_rank *r, const void *s, size_t pos) {
+    size_t start, i;
+    if (pos >= r->total)
+        return memcnt_rank_sum_(r->fcnt, r->nb);
+    i = memcnt_rank_find_(r, pos, &start);
+    return memcnt_rank_sum_(r->fcnt, i) +
+           memcnt((const unsigned char *)s + start, r->c, pos - start);
+}
+
+size_t memcnt_rank_total(const struct memcnt_rank *r) {
+    return memcnt_rank_sum_(r->fcnt, r->nb);
+}
+
+void memcnt_rank_update(struct memcnt_rank *r, const void *s, size_t pos,
+                        size_t k) {
+    size_t start, i;
+    if (!k || pos >= r->total)
+        return;
+    i = memcnt_rank_find_(r, pos, &start);
+    for (; i < r->nb && start < pos + k; start += r->len[i++])
+        memcnt_rank_recount_(r, s, i, start);
+}
+
+void memcnt_rank_insert(struct memcnt_rank *r, const void *s, size_t pos,
+                        size_t k) {
+    size_t start, i;
+    if (!k)
+        return;
+    if (pos > r->total)
+        pos = r->total;
+    /* at the end, append to the last block */
+    i = memcnt_rank_find_(r, pos, &start);
+    if (i == r->nb)
+        start -= r->len[--i];
+    r->len[i] += k;
+    r->total += k;
+    memcnt_rank_add_(r->flen, r->nb, i, k);
+    if (r->len[i] > 2 * MEMCNT_RANK_BLOCK)
+        memcnt_rank_rebalance_(r, s, i);
+    else
+        memcnt_rank_recount_(r, s, i, start);
+}
+
+void memcnt_rank_erase(struct memcnt_rank *r, const void *s, size_t pos,
+                       size_t k) {
+    size_t start, i, first, t;
+    if (pos >= r->total || !k)
+        return;
+    if (k > r->total - pos)
+        k = r->total - pos;
+    first = i = memcnt_rank_find_(r, pos, &start);
+    r->total -= k;
+    /* the bytes erased from the first block are its last ones, and from the
+       others their first ones; the blocks in between go empty */
+    for (t = pos - start; k; t = 0, ++i) {
+        size_t e = r->len[i] - t < k ? r->len[i] - t : k;
+        r->len[i] -= e, k -= e;
+        memcnt_rank_add_(r->flen, r->nb, i, 0 - e);
+        if (i != first && r->len[i])
+            memcnt_rank_recount_(r, s, i, pos);
+        else if (i != first) {
+            memcnt_rank_add_(r->fcnt, r->nb, i, 0 - r->cnt[i]);
+            r->cnt[i] = 0;
+        }
+    }
+    memcnt_rank_recount_(r, s, first, start);
+    if (r->nb > 2 * (r->total / MEMCNT_RANK_BLOCK) + 16)
+        memcnt_rank_rebalance_(r, s, r->nb);
+}
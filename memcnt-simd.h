@@ -0,0 +1,223 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* generic loop for SIMD implementations.
+
+   the implementation file defines the parameters below and then includes this
+   file, which defines the function MEMCNT_IMPL(SIMD_NAME) and undefines all
+   of the parameters again. this file may thus be included several times in
+   the same file, for example to generate variants with a different unroll.
+
+   required:
+      SIMD_NAME             name of the implementation
+      SIMD_VEC              vector type
+      SIMD_BYTES            size of SIMD_VEC in bytes, must be a power of two
+      SIMD_TOTAL            type for the running total
+      SIMD_ZERO()           SIMD_VEC with all bytes zero
+      SIMD_TOTAL_ZERO()     SIMD_TOTAL with a total of zero
+      SIMD_SPLAT(v)         SIMD_VEC with all bytes equal to v (unsigned char)
+      SIMD_LOAD(wp)         load SIMD_VEC from aligned const SIMD_VEC *wp
+      SIMD_COUNT(s, c, x)   add 1 to every byte in s where the byte in x
+                              matches the one in c (usually, is equal to
+                              it), and return the result
+      SIMD_FLUSH_ADD(t, s)  add the 8-bit counters in s to t and return it
+      SIMD_HSUM(t)          return the sum of t as a size_t
+
+   optional:
+      SIMD_UNROLL           number of vectors (and counters) per iteration,
+                              default 1. up to 8, it must be a plain number;
+                              larger values loop over the counters instead
+                              of writing out the steps for each
+      SIMD_FLUSH            number of iterations after which the 8-bit
+                              counters are flushed into the total, at most 255
+                              (the default). lower values may be needed if
+                              SIMD_FLUSH_ADD treats the counters as signed
+      SIMD_DRAIN            if 1, the total is added to the result and reset
+                              on every flush, for if SIMD_TOTAL might
+                              otherwise overflow
+      SIMD_TARGET           attributes for the function, usually
+                              MEMCNT_TARGET(isa)
+      SIMD_SCALAR(b, v)     1 if the byte b matches v, else 0, for the bytes
+                              outside the vectors; must agree with
+                              SIMD_COUNT and evaluate b once. default
+                              ((b) == (v))
+      SIMD_KEEP             if 1, the parameters are left defined, so that
+                              the file can be included again to generate a
+                              variant after redefining only some of them */
+
+#ifndef MEMCNT_IMPL_H
+#error include memcnt-impl.h before memcnt-simd.h
+#endif
+
+#ifndef SIMD_UNROLL
+#define SIMD_UNROLL 1
+#endif
+
+#ifndef SIMD_FLUSH
+#define SIMD_FLUSH 255
+#endif
+
+#ifndef SIMD_DRAIN
+#define SIMD_DRAIN 0
+#endif
+
+#ifndef SIMD_TARGET
+#define SIMD_TARGET
+#endif
+
+#ifndef SIMD_SCALAR
+#define SIMD_SCALAR(b, v) ((b) == (v))
+#endif
+
+#if SIMD_FLUSH > 255 || SIMD_FLUSH < 1
+#error SIMD_FLUSH must be between 1 and 255
+#endif
+
+#if SIMD_UNROLL < 1
+#error SIMD_UNROLL must be at least 1
+#endif
+
+#ifndef MEMCNT_SIMD_H
+#define MEMCNT_SIMD_H
+/* the steps for each of the counters are written out rather than looped
+   over, since not every compiler unrolls such loops fully (GCC does not at
+   -O2), which would leave the counters in memory instead of registers */
+#define SIMD_EACH_1_(X) X(0)
+#define SIMD_EACH_2_(X) SIMD_EACH_1_(X) X(1)
+#define SIMD_EACH_3_(X) SIMD_EACH_2_(X) X(2)
+#define SIMD_EACH_4_(X) SIMD_EACH_3_(X) X(3)
+#define SIMD_EACH_5_(X) SIMD_EACH_4_(X) X(4)
+#define SIMD_EACH_6_(X) SIMD_EACH_5_(X) X(5)
+#define SIMD_EACH_7_(X) SIMD_EACH_6_(X) X(6)
+#define SIMD_EACH_8_(X) SIMD_EACH_7_(X) X(7)
+#define SIMD_EACH__(n, X) SIMD_EACH_##n##_(X)
+#define SIMD_EACH_(n, X) SIMD_EACH__(n, X)
+
+#define SIMD_LOAD_K_(k) tmp[k] = SIMD_LOAD(wp + k);
+#define SIMD_COUNT_K_(k) sums[k] = SIMD_COUNT(sums[k], cmp, tmp[k]);
+#define SIMD_FLUSH_K_(k) totals = SIMD_FLUSH_ADD(totals, sums[k]);
+#define SIMD_ZERO_K_(k) sums[k] = SIMD_ZERO();
+#endif
+
+#undef SIMD_EACH
+#if SIMD_UNROLL > 8
+#define SIMD_EACH(X) for (k = 0; k < SIMD_UNROLL; ++k) { X(k) }
+#else
+#define SIMD_EACH(X) SIMD_EACH_(SIMD_UNROLL, X)
+#endif
+
+SIMD_TARGET MEMCNT_IMPL(SIMD_NAME)(const void *ptr, int value, size_t num) {
+    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
+    size_t c = 0;
+
+    if (num >= 2 * SIMD_BYTES) {
+#if SIMD_UNROLL > 8
+        int k;
+#endif
+        SIMD_VEC cmp = SIMD_SPLAT(v), sums[SIMD_UNROLL];
+        SIMD_TOTAL totals = SIMD_TOTAL_ZERO();
+        unsigned j = 0;
+        const SIMD_VEC *wp;
+        while (NOT_ALIGNED(p, SIMD_BYTES))
+            --num, c += SIMD_SCALAR(*p++, v);
+        wp = (const SIMD_VEC *)p;
+
+#if SIMD_UNROLL > 1
+        SIMD_EACH(SIMD_ZERO_K_)
+        while (num >= SIMD_BYTES * SIMD_UNROLL) {
+            SIMD_VEC tmp[SIMD_UNROLL];
+            num -= SIMD_BYTES * SIMD_UNROLL;
+            SIMD_EACH(SIMD_LOAD_K_)
+            wp += SIMD_UNROLL;
+            SIMD_EACH(SIMD_COUNT_K_)
+
+            if (++j == SIMD_FLUSH) {
+                SIMD_EACH(SIMD_FLUSH_K_)
+                SIMD_EACH(SIMD_ZERO_K_)
+#if SIMD_DRAIN
+                c += SIMD_HSUM(totals);
+                totals = SIMD_TOTAL_ZERO();
+#endif
+                j = 0;
+            }
+        }
+
+        SIMD_EACH(SIMD_FLUSH_K_)
+        j = 0;
+#endif
+        sums[0] = SIMD_ZERO();
+
+        while (num >= SIMD_BYTES) {
+            num -= SIMD_BYTES;
+            sums[0] = SIMD_COUNT(sums[0], cmp, SIMD_LOAD(wp));
+            ++wp;
+
+            if (++j == SIMD_FLUSH) {
+                totals = SIMD_FLUSH_ADD(totals, sums[0]);
+                sums[0] = SIMD_ZERO();
+#if SIMD_DRAIN
+                c += SIMD_HSUM(totals);
+                totals = SIMD_TOTAL_ZERO();
+#endif
+                j = 0;
+            }
+        }
+
+        totals = SIMD_FLUSH_ADD(totals, sums[0]);
+        c += SIMD_HSUM(totals);
+        p = (const unsigned char *)wp;
+    }
+    while (num--)
+        c += SIMD_SCALAR(*p++, v);
+    return c;
+}
+
+#if !SIMD_KEEP
+#undef SIMD_NAME
+#undef SIMD_VEC
+#undef SIMD_BYTES
+#undef SIMD_TOTAL
+#undef SIMD_ZERO
+#undef SIMD_TOTAL_ZERO
+#undef SIMD_SPLAT
+#undef SIMD_LOAD
+#undef SIMD_COUNT
+#undef SIMD_FLUSH_ADD
+#undef SIMD_HSUM
+#undef SIMD_UNROLL
+#undef SIMD_FLUSH
+#undef SIMD_DRAIN
+#undef SIMD_TARGET
+#undef SIMD_SCALAR
+#endif
+#undef SIMD_KEEP
@@ -0,0 +1,193 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* generic loop for SIMD implementations comparing two buffers.
+
+   this is the loop of memcnt-simd.h with a second input: the function
+   MEMCNT_IMPL(SIMD_NAME)(ptr, ptr2, num) compares each byte at ptr with the
+   byte at the same position at ptr2 instead of a fixed value. ptr is aligned
+   as in memcnt-simd.h, and ptr2 is read with unaligned loads.
+
+   the parameters are the same as for memcnt-simd.h (usually still defined
+   from it with SIMD_KEEP), with the differences below. this file must be
+   included after memcnt-simd.h.
+
+   required (in addition):
+      SIMD_LOADU(wp)        load SIMD_VEC from unaligned const SIMD_VEC *wp
+
+   changed:
+      SIMD_COUNT(s, y, x)   add to every byte in s the count for the byte x
+                              of the first buffer and y of the second; if
+                              this is more than 1, SIMD_FLUSH must be low
+                              enough that the 8-bit counters cannot overflow
+      SIMD_SCALAR(x, y)     the same for single bytes, may evaluate x and y
+                              more than once
+      SIMD_SPLAT            not used */
+
+#ifndef MEMCNT_SIMD_H
+#error include memcnt-simd.h before memcnt-simd2.h
+#endif
+
+#ifndef SIMD_UNROLL
+#define SIMD_UNROLL 1
+#endif
+
+#ifndef SIMD_FLUSH
+#define SIMD_FLUSH 255
+#endif
+
+#ifndef SIMD_DRAIN
+#define SIMD_DRAIN 0
+#endif
+
+#ifndef SIMD_TARGET
+#define SIMD_TARGET
+#endif
+
+#ifndef SIMD_SCALAR
+#define SIMD_SCALAR(x, y) ((x) == (y))
+#endif
+
+#if SIMD_FLUSH > 255 || SIMD_FLUSH < 1
+#error SIMD_FLUSH must be between 1 and 255
+#endif
+
+#if SIMD_UNROLL < 1
+#error SIMD_UNROLL must be at least 1
+#endif
+
+#ifndef MEMCNT_SIMD2_H
+#define MEMCNT_SIMD2_H
+#define SIMD2_LOAD_K_(k)                                                       \
+    tmp[k] = SIMD_LOAD(wp + k), tmq[k] = SIMD_LOADU(wq + k);
+#define SIMD2_COUNT_K_(k) sums[k] = SIMD_COUNT(sums[k], tmq[k], tmp[k]);
+#endif
+
+/* SIMD_UNROLL may have been redefined since memcnt-simd.h */
+#undef SIMD_EACH
+#if SIMD_UNROLL > 8
+#define SIMD_EACH(X) for (k = 0; k < SIMD_UNROLL; ++k) { X(k) }
+#else
+#define SIMD_EACH(X) SIMD_EACH_(SIMD_UNROLL, X)
+#endif
+
+SIMD_TARGET MEMCNT_IMPL(SIMD_NAME)(const void *ptr, const void *ptr2,
+                                   size_t num) {
+    const unsigned char *p = (unsigned char *)ptr, *q = (unsigned char *)ptr2;
+    size_t c = 0;
+
+    if (num >= 2 * SIMD_BYTES) {
+#if SIMD_UNROLL > 8
+        int k;
+#endif
+        SIMD_VEC sums[SIMD_UNROLL];
+        SIMD_TOTAL totals = SIMD_TOTAL_ZERO();
+        unsigned j = 0;
+        const SIMD_VEC *wp, *wq;
+        for (; NOT_ALIGNED(p, SIMD_BYTES); ++p, ++q)
+            --num, c += SIMD_SCALAR(*p, *q);
+        wp = (const SIMD_VEC *)p;
+        wq = (const SIMD_VEC *)q;
+
+#if SIMD_UNROLL > 1
+        SIMD_EACH(SIMD_ZERO_K_)
+        while (num >= SIMD_BYTES * SIMD_UNROLL) {
+            SIMD_VEC tmp[SIMD_UNROLL], tmq[SIMD_UNROLL];
+            num -= SIMD_BYTES * SIMD_UNROLL;
+            SIMD_EACH(SIMD2_LOAD_K_)
+            wp += SIMD_UNROLL;
+            wq += SIMD_UNROLL;
+            SIMD_EACH(SIMD2_COUNT_K_)
+
+            if (++j == SIMD_FLUSH) {
+                SIMD_EACH(SIMD_FLUSH_K_)
+                SIMD_EACH(SIMD_ZERO_K_)
+#if SIMD_DRAIN
+                c += SIMD_HSUM(totals);
+                totals = SIMD_TOTAL_ZERO();
+#endif
+                j = 0;
+            }
+        }
+
+        SIMD_EACH(SIMD_FLUSH_K_)
+        j = 0;
+#endif
+        sums[0] = SIMD_ZERO();
+
+        while (num >= SIMD_BYTES) {
+            num -= SIMD_BYTES;
+            sums[0] = SIMD_COUNT(sums[0], SIMD_LOADU(wq), SIMD_LOAD(wp));
+            ++wp, ++wq;
+
+            if (++j == SIMD_FLUSH) {
+                totals = SIMD_FLUSH_ADD(totals, sums[0]);
+                sums[0] = SIMD_ZERO();
+#if SIMD_DRAIN
+                c += SIMD_HSUM(totals);
+                totals = SIMD_TOTAL_ZERO();
+#endif
+                j = 0;
+            }
+        }
+
+        totals = SIMD_FLUSH_ADD(totals, sums[0]);
+        c += SIMD_HSUM(totals);
+        p = (const unsigned char *)wp;
+        q = (const unsigned char *)wq;
+    }
+    for (; num--; ++p, ++q)
+        c += SIMD_SCALAR(*p, *q);
+    return c;
+}
+
+#if !SIMD_KEEP
+#undef SIMD_NAME
+#undef SIMD_VEC
+#undef SIMD_BYTES
+#undef SIMD_TOTAL
+#undef SIMD_ZERO
+#undef SIMD_TOTAL_ZERO
+#undef SIMD_SPLAT
+#undef SIMD_LOAD
+#undef SIMD_LOADU
+#undef SIMD_COUNT
+#undef SIMD_FLUSH_ADD
+#undef SIMD_HSUM
+#undef SIMD_UNROLL
+#undef SIMD_FLUSH
+#undef SIMD_DRAIN
+#undef SIMD_TARGET
+#undef SIMD_SCALAR
+#endif
+#undef SIMD_KEEP
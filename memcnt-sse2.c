@@ -44,91 +44,84 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SSE2_64 1
 #endif
 
-#ifndef UNROLL
-#define UNROLL 4
-/*
+INLINE MEMCNT_TARGET("sse2") size_t sse2_hsum_mm128_epu64(__m128i v) {
+    __m128i hi = _mm_shuffle_epi32(v, 78);
 #if SSE2_64
-#define UNROLL 4
+    return (size_t)_mm_cvtsi128_si64(_mm_add_epi64(v, hi));
 #else
-#define UNROLL 2
-#endif
-*/
+    /* size_t has 32 bits here, so the low half of the sum is enough */
+    return (size_t)(unsigned)_mm_cvtsi128_si32(_mm_add_epi64(v, hi));
 #endif
+}
 
-INLINE size_t sse2_hsum_mm128_epu64(__m128i v) {
-    __m128i hi = _mm_shuffle_epi32(v, 78);
-#if SSE2_64
-    return (size_t)_mm_cvtsi128_si64(_mm_add_epi64(v, hi));
+#define SIMD_NAME sse2
+#define SIMD_VEC __m128i
+#define SIMD_BYTES 0x10
+#define SIMD_TOTAL __m128i
+#define SIMD_ZERO() _mm_setzero_si128()
+#define SIMD_TOTAL_ZERO() _mm_setzero_si128()
+#define SIMD_SPLAT(v) _mm_set1_epi8((char)(v))
+#define SIMD_LOAD(wp) _mm_load_si128(wp)
+#define SIMD_COUNT(s, c, x) _mm_sub_epi8(s, _mm_cmpeq_epi8(c, x))
+#define SIMD_FLUSH_ADD(t, s)                                                   \
+    _mm_add_epi64(t, _mm_sad_epu8(s, _mm_setzero_si128()))
+#define SIMD_HSUM(t) sse2_hsum_mm128_epu64(t)
+#define SIMD_TARGET MEMCNT_TARGET("sse2")
+#ifdef UNROLL
+#define SIMD_UNROLL UNROLL
 #else
-    __m128i vv = _mm_add_epi64(v, hi);
-    size_t s = (size_t)_mm_cvtsi128_si32(vv);
-#if !defined(SIZE_MAX) || SIZE_MAX > UINT32_MAx
-    s |= (size_t)_mm_extract_epi32(vv, 1) << 32;
+#define SIMD_UNROLL 4
 #endif
-    return s;
+#define SIMD_KEEP (MEMCNT_UTF8 || MEMCNT_EQ2)
+#include "memcnt-simd.h"
+
+#if MEMCNT_UTF8
+/* memcnt_sse2_utf8 (for memcnt-utf8.c) is called with c = 0xBF and
+   counts the bytes greater than it as signed chars (-65), which are those
+   that start a UTF-8 character */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME sse2_utf8
+#define SIMD_COUNT(s, c, x) _mm_sub_epi8(s, _mm_cmpgt_epi8(x, c))
+#define SIMD_SCALAR(b, v) MEMCNT_UTF8_LEAD(b)
+#define SIMD_KEEP MEMCNT_EQ2
+#include "memcnt-simd.h"
 #endif
+
+#if MEMCNT_EQ2
+/* memcnt_sse2_eq2 and memcnt_sse2_ham (for memcnt-eq2.c) count the
+   equal bytes and the differing bits of two buffers */
+
+/* the number of bits set in each byte of x (there is no PSHUFB in SSE2 for a
+   lookup, so this is the same as MEMCNT_BITS8) */
+INLINE MEMCNT_TARGET("sse2") __m128i sse2_popcnt_epi8_(__m128i x) {
+    __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33),
+            m4 = _mm_set1_epi8(0x0F);
+    x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+    x = _mm_add_epi8(_mm_and_si128(x, m2),
+                     _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+    return _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
 }
 
-MEMCNT_IMPL(sse2)(const void *ptr, int value, size_t num) {
-    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
-    size_t c = 0;
-
-    if (num >= 32) {
-        int k;
-        __m128i cmp = _mm_set1_epi8((char)v), sums[UNROLL],
-                totals = _mm_setzero_si128();
-        uint8_t j = 1;
-        const __m128i *wp;
-        while (NOT_ALIGNED(p, 0x10))
-            --num, c += *p++ == v;
-        wp = (const __m128i *)p;
-
-#if UNROLL > 1
-        for (k = 0; k < UNROLL; ++k)
-            sums[k] = _mm_setzero_si128();
-        while (num >= 0x10 * UNROLL) {
-            __m128i tmp[UNROLL];
-            num -= 0x10 * UNROLL;
-            for (k = 0; k < UNROLL; ++k)
-                tmp[k] = *wp++;
-            for (k = 0; k < UNROLL; ++k)
-                sums[k] = _mm_sub_epi8(sums[k], _mm_cmpeq_epi8(cmp, tmp[k]));
-
-            if (++j == 0) {
-                for (k = 0; k < UNROLL; ++k)
-                    totals = _mm_add_epi64(
-                        totals, _mm_sad_epu8(sums[k], _mm_setzero_si128()));
-                for (k = 0; k < UNROLL; ++k)
-                    sums[k] = _mm_setzero_si128();
-                j = 1;
-            }
-        }
-
-        for (k = 0; k < UNROLL; ++k)
-            totals = _mm_add_epi64(totals,
-                                   _mm_sad_epu8(sums[k], _mm_setzero_si128()));
-        j = 1;
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME sse2_eq2
+#define SIMD_LOADU(wp) _mm_loadu_si128(wp)
+#define SIMD_COUNT(s, y, x) _mm_sub_epi8(s, _mm_cmpeq_epi8(y, x))
+#define SIMD_KEEP 1
+#include "memcnt-simd2.h"
+
+/* each byte of the counters grows by up to 8 per iteration */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#undef SIMD_FLUSH
+#define SIMD_NAME sse2_ham
+#define SIMD_COUNT(s, y, x)                                                    \
+    _mm_add_epi8(s, sse2_popcnt_epi8_(_mm_xor_si128(x, y)))
+#define SIMD_SCALAR(x, y) MEMCNT_BITS8((x) ^ (y))
+#define SIMD_FLUSH 31
+#include "memcnt-simd2.h"
 #endif
-        sums[0] = _mm_setzero_si128();
-
-        while (num >= 0x10) {
-            num -= 0x10;
-            sums[0] = _mm_sub_epi8(sums[0], _mm_cmpeq_epi8(cmp, *wp++));
-
-            if (++j == 0) {
-                totals = _mm_add_epi64(
-                    totals, _mm_sad_epu8(sums[0], _mm_setzero_si128()));
-                sums[0] = _mm_setzero_si128();
-                j = 1;
-            }
-        }
-
-        totals =
-            _mm_add_epi64(totals, _mm_sad_epu8(sums[0], _mm_setzero_si128()));
-        c += sse2_hsum_mm128_epu64(totals);
-        p = (const unsigned char *)wp;
-    }
-    while (num--)
-        c += *p++ == v;
-    return c;
-}
@@ -0,0 +1,309 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_stats (call statistics of memcnt). this file is included by
+   memcnt.c after the memcnt implementations when MEMCNT_STATS is 1; the
+   memcnt defined there then counts each call with memcnt_stats_count_
+   before calling the implementation.
+
+   every thread counts into a slot of its own, found through a thread-local
+   pointer, so that counting takes no locks or atomic read-modify-write
+   instructions: only the thread itself writes to its slot, and
+   memcnt_stats only reads the slots. a thread claims a free slot the first
+   time it calls memcnt and gives it back when it exits, and the next thread
+   to claim the slot carries on adding to its counts. if all
+   MEMCNT_STATS_THREADS - 1 slots are taken, the thread shares the last one
+   with atomic additions (as do all threads if there is no thread-local
+   storage).
+   the counts are kept per implementation that memcnt has used, which is the
+   one picked at compile time until memcnt_optimize picks another one. */
+
+#include "memcnt-impl.h"
+
+#ifndef MEMCNT_STATS_THREADS
+#define MEMCNT_STATS_THREADS 64
+#endif
+
+/* time every MEMCNT_STATS_SAMPLE-th call of each thread, 0 for none */
+#ifndef MEMCNT_STATS_SAMPLE
+#define MEMCNT_STATS_SAMPLE 0
+#endif
+
+#if defined(__GNUC__)
+#define MEMCNT_STATS_LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define MEMCNT_STATS_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define MEMCNT_STATS_FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define MEMCNT_STATS_CAS(p, o, n) __sync_bool_compare_and_swap(p, o, n)
+#define MEMCNT_STATS_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+/* volatile accesses of aligned words are atomic with MSVC */
+#define MEMCNT_STATS_LOAD(p) (*(volatile size_t *)(p))
+#define MEMCNT_STATS_STORE(p, v) (*(volatile size_t *)(p) = (v))
+#if defined(_WIN64)
+#define MEMCNT_STATS_FETCH_ADD(p, v)                                           \
+    (size_t) _InterlockedExchangeAdd64((volatile __int64 *)(p), (__int64)(v))
+#define MEMCNT_STATS_CAS(p, o, n)                                              \
+    (_InterlockedCompareExchange64((volatile __int64 *)(p), (__int64)(n),      \
+                                   (__int64)(o)) == (__int64)(o))
+#define MEMCNT_STATS_RELEASE(p, v)                                             \
+    (void)_InterlockedExchange64((volatile __int64 *)(p), (__int64)(v))
+#else
+#define MEMCNT_STATS_FETCH_ADD(p, v)                                           \
+    (size_t) _InterlockedExchangeAdd((volatile long *)(p), (long)(v))
+#define MEMCNT_STATS_CAS(p, o, n)                                              \
+    (_InterlockedCompareExchange((volatile long *)(p), (long)(n),              \
+                                 (long)(o)) == (long)(o))
+#define MEMCNT_STATS_RELEASE(p, v)                                             \
+    (void)_InterlockedExchange((volatile long *)(p), (long)(v))
+#endif
+#else
+#error MEMCNT_STATS needs GCC, clang or MSVC for atomic operations
+#endif
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define MEMCNT_THREAD_LOCAL thread_local
+#elif MEMCNT_C11 && !defined(__STDC_NO_THREADS__)
+#define MEMCNT_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define MEMCNT_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define MEMCNT_THREAD_LOCAL __declspec(thread)
+#endif
+
+/* giving the slot back when its thread exits: with a fiber-local storage
+   callback on Windows and with the destructor of a pthread key elsewhere.
+   without either, a thread keeps its slot after it exits */
+#ifndef MEMCNT_THREAD_LOCAL
+#elif defined(_WIN32)
+#include <Windows.h>
+#define MEMCNT_STATS_FLS 1
+#elif defined(__has_include)
+#if __has_include(<pthread.h>)
+#include <pthread.h>
+#define MEMCNT_STATS_PTHREAD 1
+#endif
+#endif
+
+/* the timer for sampling: cycles on x86 and the generic timer on ARM */
+#if !MEMCNT_STATS_SAMPLE
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define MEMCNT_STATS_TICKS() ((size_t)__builtin_ia32_rdtsc())
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define MEMCNT_STATS_TICKS() ((size_t)__rdtsc())
+#elif defined(__GNUC__) && defined(__aarch64__)
+INLINE size_t memcnt_stats_ticks_(void) {
+    size_t t;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+}
+#define MEMCNT_STATS_TICKS() memcnt_stats_ticks_()
+#else
+#undef MEMCNT_STATS_SAMPLE
+#define MEMCNT_STATS_SAMPLE 0
+#endif
+
+struct memcnt_stats_counts_ {
+    size_t calls, bytes, sizes[MEMCNT_STATS_BUCKETS];
+    size_t sampled_calls, sampled_bytes, sampled_ticks;
+};
+
+struct memcnt_stats_slot_ {
+    struct memcnt_stats_counts_ impl[MEMCNT_STATS_IMPLS];
+    /* 1 while a thread has the slot */
+    size_t used;
+    /* so that no two threads write to the same cache line */
+    char pad[64];
+};
+
+static struct memcnt_stats_slot_ memcnt_stats_slots_[MEMCNT_STATS_THREADS];
+/* the number of threads that have called memcnt */
+static size_t memcnt_stats_threads_;
+/* the implementation memcnt calls now, and the names of those it has */
+static int memcnt_stats_impl_;
+static const char *memcnt_stats_names_[MEMCNT_STATS_IMPLS] = {
+    STRINGIFYVAL(MEMCNT_INITIAL)};
+#define MEMCNT_STATS_SHARED_ (&memcnt_stats_slots_[MEMCNT_STATS_THREADS - 1])
+
+#ifdef MEMCNT_THREAD_LOCAL
+static MEMCNT_THREAD_LOCAL struct memcnt_stats_slot_ *memcnt_stats_mine_;
+
+#if MEMCNT_STATS_FLS || MEMCNT_STATS_PTHREAD
+/* called when a thread that has a slot exits */
+static void memcnt_stats_exit_(void *p) {
+    struct memcnt_stats_slot_ *slot = (struct memcnt_stats_slot_ *)p;
+    /* the destructors that run after this one may still call memcnt */
+    memcnt_stats_mine_ = MEMCNT_STATS_SHARED_;
+    MEMCNT_STATS_RELEASE(&slot->used, 0);
+}
+#endif
+
+#if MEMCNT_STATS_FLS
+static size_t memcnt_stats_fls_ = (size_t)FLS_OUT_OF_INDEXES;
+
+static VOID WINAPI memcnt_stats_fls_exit_(PVOID p) { memcnt_stats_exit_(p); }
+
+static void memcnt_stats_on_exit_(struct memcnt_stats_slot_ *slot) {
+    size_t k = MEMCNT_STATS_LOAD(&memcnt_stats_fls_);
+    if (k == (size_t)FLS_OUT_OF_INDEXES) {
+        DWORD n = FlsAlloc(&memcnt_stats_fls_exit_);
+        if (n != FLS_OUT_OF_INDEXES &&
+            !MEMCNT_STATS_CAS(&memcnt_stats_fls_, k, (size_t)n))
+            FlsFree(n);
+        k = MEMCNT_STATS_LOAD(&memcnt_stats_fls_);
+    }
+    if (k != (size_t)FLS_OUT_OF_INDEXES)
+        FlsSetValue((DWORD)k, slot);
+}
+#elif MEMCNT_STATS_PTHREAD
+static pthread_key_t memcnt_stats_key_;
+static pthread_once_t memcnt_stats_once_ = PTHREAD_ONCE_INIT;
+static int memcnt_stats_keyed_;
+
+static void memcnt_stats_key_init_(void) {
+    memcnt_stats_keyed_ =
+        !pthread_key_create(&memcnt_stats_key_, &memcnt_stats_exit_);
+}
+
+static void memcnt_stats_on_exit_(struct memcnt_stats_slot_ *slot) {
+    pthread_once(&memcnt_stats_once_, &memcnt_stats_key_init_);
+    if (memcnt_stats_keyed_)
+        pthread_setspecific(memcnt_stats_key_, slot);
+}
+#endif
+
+static struct memcnt_stats_slot_ *memcnt_stats_claim_(void) {
+    struct memcnt_stats_slot_ *slot = MEMCNT_STATS_SHARED_;
+    size_t i;
+    MEMCNT_STATS_FETCH_ADD(&memcnt_stats_threads_, 1);
+    for (i = 0; i < MEMCNT_STATS_THREADS - 1; ++i) {
+        if (!MEMCNT_STATS_LOAD(&memcnt_stats_slots_[i].used) &&
+            MEMCNT_STATS_CAS(&memcnt_stats_slots_[i].used, 0, 1)) {
+            slot = &memcnt_stats_slots_[i];
+#if MEMCNT_STATS_FLS || MEMCNT_STATS_PTHREAD
+            memcnt_stats_on_exit_(slot);
+#endif
+            break;
+        }
+    }
+    return memcnt_stats_mine_ = slot;
+}
+
+#define MEMCNT_STATS_SLOT_()                                                   \
+    (memcnt_stats_mine_ ? memcnt_stats_mine_ : memcnt_stats_claim_())
+#else
+#define MEMCNT_STATS_SLOT_() MEMCNT_STATS_SHARED_
+#endif
+
+/* only the owner writes to its slot, so a load and a store will do */
+#define MEMCNT_STATS_ADD_(slot, p, v)                                          \
+    ((slot) == MEMCNT_STATS_SHARED_                                            \
+         ? (void)MEMCNT_STATS_FETCH_ADD(p, v)                                  \
+         : (void)MEMCNT_STATS_STORE(p, *(p) + (v)))
+
+/* 0 for 0, otherwise 1 + floor(log2(n)) */
+INLINE int memcnt_stats_bucket_(size_t n) {
+#if defined(__GNUC__) && defined(__SIZEOF_SIZE_T__) &&                         \
+    __SIZEOF_SIZE_T__ == __SIZEOF_LONG__
+    return n ? (int)(sizeof(unsigned long) * CHAR_BIT) -
+                   __builtin_clzl((unsigned long)n)
+             : 0;
+#else
+    int b = 0;
+    while (n)
+        n >>= 1, ++b;
+    return b;
+#endif
+}
+
+#if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
+/* called by memcnt_optimize with the implementation it picked */
+static void memcnt_stats_resolve_(const char *name) {
+    const char *a = name, *b = memcnt_stats_names_[0];
+    while (*a && *a == *b)
+        ++a, ++b;
+    if (*a != *b) {
+        memcnt_stats_names_[1] = name;
+        memcnt_stats_impl_ = 1;
+    }
+}
+#endif
+
+INLINE size_t memcnt_stats_count_(const void *s, int c, size_t n) {
+    struct memcnt_stats_slot_ *slot = MEMCNT_STATS_SLOT_();
+    struct memcnt_stats_counts_ *k = &slot->impl[memcnt_stats_impl_];
+    size_t r;
+#if MEMCNT_STATS_SAMPLE
+    if (k->calls % MEMCNT_STATS_SAMPLE == 0) {
+        size_t t = MEMCNT_STATS_TICKS();
+        r = memcnt_uncounted_(s, c, n);
+        t = MEMCNT_STATS_TICKS() - t;
+        MEMCNT_STATS_ADD_(slot, &k->sampled_calls, 1);
+        MEMCNT_STATS_ADD_(slot, &k->sampled_bytes, n);
+        MEMCNT_STATS_ADD_(slot, &k->sampled_ticks, t);
+    } else
+#endif
+        r = memcnt_uncounted_(s, c, n);
+    MEMCNT_STATS_ADD_(slot, &k->calls, 1);
+    MEMCNT_STATS_ADD_(slot, &k->bytes, n);
+    MEMCNT_STATS_ADD_(slot, &k->sizes[memcnt_stats_bucket_(n)], 1);
+    return r;
+}
+
+void memcnt_stats(struct memcnt_stats *st) {
+    size_t t;
+    int i, b;
+    st->threads = MEMCNT_STATS_LOAD(&memcnt_stats_threads_);
+    for (i = 0; i < MEMCNT_STATS_IMPLS; ++i) {
+        struct memcnt_stats_impl *d = &st->impl[i];
+        d->name = memcnt_stats_names_[i];
+        d->calls = d->bytes = 0;
+        d->sampled_calls = d->sampled_bytes = 0;
+        d->sampled_ticks = 0;
+        for (b = 0; b < MEMCNT_STATS_BUCKETS; ++b)
+            d->sizes[b] = 0;
+        /* the slots of the threads (including those that have exited) and
+           the shared one */
+        for (t = 0; t < MEMCNT_STATS_THREADS; ++t) {
+            const struct memcnt_stats_counts_ *k =
+                &memcnt_stats_slots_[t].impl[i];
+            d->calls += MEMCNT_STATS_LOAD(&k->calls);
+            d->bytes += MEMCNT_STATS_LOAD(&k->bytes);
+            for (b = 0; b < MEMCNT_STATS_BUCKETS; ++b)
+                d->sizes[b] += MEMCNT_STATS_LOAD(&k->sizes[b]);
+            d->sampled_calls += MEMCNT_STATS_LOAD(&k->sampled_calls);
+            d->sampled_bytes += MEMCNT_STATS_LOAD(&k->sampled_bytes);
+            d->sampled_ticks += (double)MEMCNT_STATS_LOAD(&k->sampled_ticks);
+        }
+    }
+}
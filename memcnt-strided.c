@@ -0,0 +1,265 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_strided and memcnt_2d (for counting in interleaved data and in
+   pitched 2D regions). this file is included by memcnt.c after the memcnt
+   implementations.
+
+   strides up to MEMCNT_STRIDED_MAX are counted 16 to 64 bytes at a time by
+   masking the comparisons (see memcnt-strided.h). longer strides are counted
+   one element at a time, since by then most of the bytes read would be
+   wasted and there is no byte gather to fetch only the elements. 2D regions
+   are counted with memcnt one row at a time. */
+
+#include "memcnt-impl.h"
+
+/* the longest stride counted with masks; longer ones would need more masks
+   than fit in registers */
+#ifndef MEMCNT_STRIDED_MAX
+#define MEMCNT_STRIDED_MAX 8
+#endif
+
+#if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
+#define MEMCNT_STRIDED_DYNAMIC 1
+#else
+#define MEMCNT_STRIDED_DYNAMIC 0
+#endif
+
+/* counts one element at a time */
+INLINE size_t memcnt_strided_loop_(const void *ptr, int value, size_t count,
+                                   size_t stride) {
+    size_t c = 0, i;
+    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
+    for (i = 0; i < count; ++i)
+        c += p[i * stride] == v;
+    return c;
+}
+
+#if MEMCNT_CAN_MULTIARCH
+/* the number of vectors of the given size after which the mask for the
+   stride repeats, stride / gcd(stride, bytes) (bytes is a power of two) */
+INLINE unsigned memcnt_strided_period_(size_t stride, size_t bytes) {
+    size_t low = stride & (0 - stride);
+    return (unsigned)(stride / (low < bytes ? low : bytes));
+}
+#endif
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_STDINT && !MEMCNT_NAIVE
+
+/* Intel AVX-512(BW) */
+#if MEMCNT_COMPILED_avx512
+#define STR_NAME avx512_strided
+#define STR_VEC __m512i
+#define STR_BYTES 0x40
+#define STR_TOTAL __m512i
+#define STR_ZERO() _mm512_setzero_si512()
+#define STR_TOTAL_ZERO() _mm512_setzero_si512()
+#define STR_SPLAT(v) _mm512_set1_epi8((char)(v))
+#define STR_LOAD(wp) _mm512_load_si512(wp)
+#define STR_COUNT(s, c, x, m)                                                  \
+    _mm512_mask_sub_epi8(s, _mm512_cmpeq_epi8_mask(c, x), s, m)
+#define STR_FLUSH_ADD(t, s)                                                    \
+    _mm512_add_epi64(t, _mm512_sad_epu8(s, _mm512_setzero_si512()))
+#define STR_HSUM(t) ((size_t)_mm512_reduce_add_epi64(t))
+#define STR_TARGET MEMCNT_TARGET("avx512f,avx512bw")
+#include "memcnt-strided.h"
+#ifndef MEMCNT_STRIDED_PICKED
+#define MEMCNT_STRIDED_PICKED MEMCNT_NAME(avx512_strided)
+#endif
+#endif
+
+/* Intel AVX2 */
+#if MEMCNT_COMPILED_avx2 &&                                                    \
+    (MEMCNT_STRIDED_DYNAMIC || !defined(MEMCNT_STRIDED_PICKED))
+#define STR_NAME avx2_strided
+#define STR_VEC __m256i
+#define STR_BYTES 0x20
+#define STR_TOTAL __m256i
+#define STR_ZERO() _mm256_setzero_si256()
+#define STR_TOTAL_ZERO() _mm256_setzero_si256()
+#define STR_SPLAT(v) _mm256_set1_epi8((char)(v))
+#define STR_LOAD(wp) _mm256_load_si256(wp)
+#define STR_COUNT(s, c, x, m)                                                  \
+    _mm256_sub_epi8(s, _mm256_and_si256(_mm256_cmpeq_epi8(c, x), m))
+#define STR_FLUSH_ADD(t, s)                                                    \
+    _mm256_add_epi64(t, _mm256_sad_epu8(s, _mm256_setzero_si256()))
+#define STR_HSUM(t) avx2_hsum_mm256_epu64(t)
+#define STR_TARGET MEMCNT_TARGET("avx2")
+#include "memcnt-strided.h"
+#ifndef MEMCNT_STRIDED_PICKED
+#define MEMCNT_STRIDED_PICKED MEMCNT_NAME(avx2_strided)
+#endif
+#endif
+
+/* Intel SSE2 */
+#if MEMCNT_COMPILED_sse2 &&                                                    \
+    (MEMCNT_STRIDED_DYNAMIC || !defined(MEMCNT_STRIDED_PICKED))
+#define STR_NAME sse2_strided
+#define STR_VEC __m128i
+#define STR_BYTES 0x10
+#define STR_TOTAL __m128i
+#define STR_ZERO() _mm_setzero_si128()
+#define STR_TOTAL_ZERO() _mm_setzero_si128()
+#define STR_SPLAT(v) _mm_set1_epi8((char)(v))
+#define STR_LOAD(wp) _mm_load_si128(wp)
+#define STR_COUNT(s, c, x, m)                                                  \
+    _mm_sub_epi8(s, _mm_and_si128(_mm_cmpeq_epi8(c, x), m))
+#define STR_FLUSH_ADD(t, s)                                                    \
+    _mm_add_epi64(t, _mm_sad_epu8(s, _mm_setzero_si128()))
+#define STR_HSUM(t) sse2_hsum_mm128_epu64(t)
+#define STR_TARGET MEMCNT_TARGET("sse2")
+#include "memcnt-strided.h"
+#ifndef MEMCNT_STRIDED_PICKED
+#define MEMCNT_STRIDED_PICKED MEMCNT_NAME(sse2_strided)
+#endif
+#endif
+
+/* ARM Neon */
+#if MEMCNT_COMPILED_neon &&                                                    \
+    (MEMCNT_STRIDED_DYNAMIC || !defined(MEMCNT_STRIDED_PICKED))
+#define STR_NAME neon_strided
+#define STR_VEC uint8x16_t
+#define STR_BYTES 0x10
+#define STR_TOTAL uint64x2_t
+#define STR_ZERO() vdupq_n_u8(0)
+#define STR_TOTAL_ZERO() vdupq_n_u64(0)
+#define STR_SPLAT(v) vdupq_n_u8((uint8_t)(v))
+#define STR_LOAD(wp) vld1q_u8((const uint8_t *)(wp))
+#define STR_COUNT(s, c, x, m) vsubq_u8(s, vandq_u8(vceqq_u8(c, x), m))
+#define STR_FLUSH_ADD(t, s) vpadalq_u32(t, vpaddlq_u16(vpaddlq_u8(s)))
+#define STR_HSUM(t) neon_hsum_u64x2(t)
+#include "memcnt-strided.h"
+#ifndef MEMCNT_STRIDED_PICKED
+#define MEMCNT_STRIDED_PICKED MEMCNT_NAME(neon_strided)
+#endif
+#endif
+
+#endif
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_WIDE &&                                     \
+    (MEMCNT_STRIDED_DYNAMIC || !defined(MEMCNT_STRIDED_PICKED))
+#define STR_NAME wide_strided
+#define STR_VEC memcnt_word_t
+#define STR_BYTES MEMCNT_COUNT
+#define STR_TOTAL size_t
+#define STR_ZERO() ((memcnt_word_t)0)
+#define STR_TOTAL_ZERO() 0
+#define STR_SPLAT(v) ((memcnt_word_t)(wide_lo_ * (v)))
+#define STR_LOAD(wp) (*(wp))
+#define STR_COUNT(s, c, x, m) ((s) + (wide_zeros_((x) ^ (c)) & (m)))
+#define STR_FLUSH_ADD(t, s) ((t) + wide_hsum_(s))
+#define STR_HSUM(t) (t)
+/* with words, loading the elements one by one is faster for longer strides */
+#define STR_MAX 3
+#include "memcnt-strided.h"
+#define MEMCNT_STRIDED_FALLBACK MEMCNT_NAME(wide_strided)
+#ifndef MEMCNT_STRIDED_PICKED
+#define MEMCNT_STRIDED_PICKED MEMCNT_NAME(wide_strided)
+#endif
+#endif
+
+#if !defined(MEMCNT_STRIDED_PICKED) ||                                         \
+    (MEMCNT_STRIDED_DYNAMIC && !defined(MEMCNT_STRIDED_FALLBACK))
+/* not MEMCNT_IMPL, which names memcnt itself if it is the only one */
+static size_t MEMCNT_NAME(default_strided)(const void *ptr, int value,
+                                           size_t count, size_t stride) {
+    return memcnt_strided_loop_(ptr, value, count, stride);
+}
+#define MEMCNT_STRIDED_FALLBACK MEMCNT_NAME(default_strided)
+#ifndef MEMCNT_STRIDED_PICKED
+#define MEMCNT_STRIDED_PICKED MEMCNT_NAME(default_strided)
+#endif
+#endif
+
+#if MEMCNT_STRIDED_DYNAMIC
+/* the fallback until memcnt_optimize checks the CPU */
+static size_t (*memcnt_strided_impl_)(const void *, int, size_t, size_t) =
+    &MEMCNT_STRIDED_FALLBACK;
+
+#define MEMCNT_STRIDED_CANDIDATE(implname)                                     \
+    else if (MEMCNT_DCHECK_##implname) memcnt_strided_impl_ =                  \
+        &MEMCNT_NAME(implname##_strided);
+
+/* called by memcnt_optimize */
+static void memcnt_strided_optimize_(void) {
+    if (0)
+        ;
+
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+    MEMCNT_STRIDED_CANDIDATE(avx512)
+#endif
+
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+    MEMCNT_STRIDED_CANDIDATE(avx2)
+#endif
+
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+    MEMCNT_STRIDED_CANDIDATE(sse2)
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(MEMCNT_DCHECK_neon)
+    MEMCNT_STRIDED_CANDIDATE(neon)
+#endif
+
+    else
+        memcnt_strided_impl_ = &MEMCNT_STRIDED_FALLBACK;
+}
+
+#define MEMCNT_STRIDED_CALL (*memcnt_strided_impl_)
+#else
+#define MEMCNT_STRIDED_CALL MEMCNT_STRIDED_PICKED
+#endif
+
+size_t memcnt_strided(const void *s, int c, size_t count, size_t stride) {
+    if (!count)
+        return 0;
+    if (stride == 1)
+        return memcnt(s, c, count);
+    if (stride == 0 || stride > MEMCNT_STRIDED_MAX)
+        return memcnt_strided_loop_(s, c, count, stride);
+    return MEMCNT_STRIDED_CALL(s, c, count, stride);
+}
+
+size_t memcnt_2d(const void *s, int c, size_t width, size_t height,
+                 size_t pitch) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t count = 0;
+    if (pitch == width && height)
+        return memcnt(p, c, width * height);
+    while (height--) {
+        count += memcnt(p, c, width);
+        if (height)
+            p += pitch;
+    }
+    return count;
+}
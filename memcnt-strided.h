@@ -0,0 +1,145 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* generic loop for memcnt_strided (see memcnt-strided.c).
+
+   rather than gathering the elements, the loop compares every byte and only
+   counts those that are elements, by ANDing the comparison with a mask that
+   selects every stride-th byte. the mask repeats after as many vectors as
+   stride / gcd(stride, STR_BYTES), at most MEMCNT_STRIDED_MAX; such a group
+   of vectors is processed per iteration with one mask for each vector. for
+   the small strides handled here, this reads the same cache lines as a
+   gather would anyway.
+
+   like memcnt-simd.h, the implementation defines the parameters below and
+   then includes this file, which undefines them again.
+
+   required:
+      STR_NAME              name of the implementation
+      STR_VEC               vector type
+      STR_BYTES             size of STR_VEC in bytes, must be a power of two
+      STR_TOTAL             type for the running total
+      STR_ZERO()            STR_VEC with all bytes zero
+      STR_TOTAL_ZERO()      STR_TOTAL with a total of zero
+      STR_SPLAT(v)          STR_VEC with all bytes equal to v (unsigned char)
+      STR_LOAD(wp)          load STR_VEC from aligned const STR_VEC *wp
+      STR_COUNT(s, c, x, m) add 1 to every byte in s where the byte in x is
+                              equal to the one in c and the byte in m is
+                              0xFF (rather than 0), and return the result
+      STR_FLUSH_ADD(t, s)   add the 8-bit counters in s to t and return it
+      STR_HSUM(t)           return the sum of t as a size_t
+
+   optional:
+      STR_MAX               the longest stride to count with masks, if less
+                              than MEMCNT_STRIDED_MAX; longer ones are
+                              counted one element at a time
+      STR_TARGET            attributes for the function, usually
+                              MEMCNT_TARGET(isa) */
+
+#ifndef MEMCNT_IMPL_H
+#error include memcnt-impl.h before memcnt-strided.h
+#endif
+
+#ifndef STR_MAX
+#define STR_MAX MEMCNT_STRIDED_MAX
+#endif
+
+#ifndef STR_TARGET
+#define STR_TARGET
+#endif
+
+/* count must be at least 1, and stride from 2 to MEMCNT_STRIDED_MAX */
+STR_TARGET MEMCNT_IMPL(STR_NAME)(const void *ptr, int value, size_t count,
+                                 size_t stride) {
+    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
+    size_t c = 0, i = 0, num = (count - 1) * stride + 1;
+
+    if (stride > STR_MAX)
+        return memcnt_strided_loop_(ptr, value, count, stride);
+    if (num >= 4 * MEMCNT_STRIDED_MAX * STR_BYTES) {
+        STR_VEC cmp = STR_SPLAT(v), sums = STR_ZERO(),
+                masks[MEMCNT_STRIDED_MAX];
+        STR_TOTAL totals = STR_TOTAL_ZERO();
+        unsigned char *mb = (unsigned char *)masks;
+        size_t head = 0, group, groups, k;
+        unsigned g, j = 0, ng, flush;
+        const STR_VEC *wp;
+        if (NOT_ALIGNED(p, STR_BYTES))
+            head = STR_BYTES - NOT_ALIGNED(p, STR_BYTES);
+        for (; i < head; i += stride)
+            c += p[i] == v;
+
+        ng = memcnt_strided_period_(stride, STR_BYTES);
+        group = (size_t)ng * STR_BYTES;
+        for (k = 0; k < group; ++k)
+            mb[k] = (head + k) % stride ? 0 : 0xFF;
+        /* each byte of the counters grows by up to ng per group */
+        flush = 255 / ng;
+        wp = (const STR_VEC *)(p + head);
+
+        for (groups = (num - head) / group; groups; --groups) {
+            for (g = 0; g < ng; ++g)
+                sums = STR_COUNT(sums, cmp, STR_LOAD(wp + g), masks[g]);
+            wp += ng;
+
+            if (++j == flush) {
+                totals = STR_FLUSH_ADD(totals, sums);
+                sums = STR_ZERO();
+                j = 0;
+            }
+        }
+
+        totals = STR_FLUSH_ADD(totals, sums);
+        c += STR_HSUM(totals);
+        /* the first element after the groups */
+        i = (size_t)((const unsigned char *)wp - p) + stride - 1;
+        i -= i % stride;
+    }
+    for (; i < num; i += stride)
+        c += p[i] == v;
+    return c;
+}
+
+#undef STR_NAME
+#undef STR_VEC
+#undef STR_BYTES
+#undef STR_TOTAL
+#undef STR_ZERO
+#undef STR_TOTAL_ZERO
+#undef STR_SPLAT
+#undef STR_LOAD
+#undef STR_COUNT
+#undef STR_FLUSH_ADD
+#undef STR_HSUM
+#undef STR_MAX
+#undef STR_TARGET
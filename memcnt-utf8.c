@@ -0,0 +1,187 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* memcnt_utf8_chars and memcnt_utf8_pos (for counting characters in UTF-8
+   text). this file is included by memcnt.c after the memcnt implementations.
+
+   a byte starts a character unless it is a continuation byte (0x80-0xBF).
+   the SIMD implementations are generated by the memcnt-*.c files from the same
+   loop as memcnt, with a signed comparison in place of the equality
+   comparison, so counting characters is as fast as counting bytes. */
+
+#include "memcnt-impl.h"
+
+#if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
+#define MEMCNT_UTF8_DYNAMIC 1
+#else
+#define MEMCNT_UTF8_DYNAMIC 0
+#endif
+
+#if MEMCNT_COMPILED_avx512
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(avx512_utf8)
+#elif MEMCNT_COMPILED_avx2
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(avx2_utf8)
+#elif MEMCNT_COMPILED_sse2
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(sse2_utf8)
+#elif MEMCNT_COMPILED_neon
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(neon_utf8)
+#elif MEMCNT_COMPILED_wasm_simd
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(wasm_simd_utf8)
+#endif
+
+#if MEMCNT_CAN_MULTIARCH && MEMCNT_WIDE &&                                     \
+    (MEMCNT_UTF8_DYNAMIC || !defined(MEMCNT_UTF8_PICKED))
+/* memcnt_wide_utf8: counts the continuation bytes, which are those with the
+   top bits 10, and subtracts them from the bytes counted */
+MEMCNT_IMPL(wide_utf8)(const void *ptr, int value, size_t num) {
+    size_t c = 0;
+    const unsigned char *p = (unsigned char *)ptr;
+    (void)value;
+    if (num >= MEMCNT_COUNT * 2) {
+        memcnt_word_t sums = 0;
+        uint8_t j = 1;
+        const memcnt_word_t *wp;
+        while (NOT_ALIGNED(p, MEMCNT_COUNT))
+            --num, c += MEMCNT_UTF8_LEAD(*p++);
+        wp = (const memcnt_word_t *)p;
+
+        while (num >= MEMCNT_COUNT) {
+            memcnt_word_t w = *wp++;
+            num -= MEMCNT_COUNT;
+            c += MEMCNT_COUNT;
+            /* 01 in the bytes where bit 7 is set and bit 6 is not */
+            sums += (w >> 7) & ~(w >> 6) & wide_lo_;
+            if (++j == 0) {
+                c -= wide_hsum_(sums);
+                sums = 0;
+                j = 1;
+            }
+        }
+
+        c -= wide_hsum_(sums);
+        p = (const unsigned char *)wp;
+    }
+    while (num--)
+        c += MEMCNT_UTF8_LEAD(*p++);
+    return c;
+}
+#define MEMCNT_UTF8_FALLBACK MEMCNT_NAME(wide_utf8)
+#ifndef MEMCNT_UTF8_PICKED
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(wide_utf8)
+#endif
+#endif
+
+#if !defined(MEMCNT_UTF8_PICKED) ||                                            \
+    (MEMCNT_UTF8_DYNAMIC && !defined(MEMCNT_UTF8_FALLBACK))
+/* not MEMCNT_IMPL, which names memcnt itself if it is the only one */
+static size_t MEMCNT_NAME(default_utf8)(const void *ptr, int value,
+                                        size_t num) {
+    size_t c = 0;
+    const unsigned char *p = (unsigned char *)ptr;
+    (void)value;
+    while (num--)
+        c += MEMCNT_UTF8_LEAD(*p++);
+    return c;
+}
+#define MEMCNT_UTF8_FALLBACK MEMCNT_NAME(default_utf8)
+#ifndef MEMCNT_UTF8_PICKED
+#define MEMCNT_UTF8_PICKED MEMCNT_NAME(default_utf8)
+#endif
+#endif
+
+#if MEMCNT_UTF8_DYNAMIC
+/* the picked implementation may need instructions that the CPU does not
+   have, so start with the fallback until memcnt_optimize checks */
+static size_t (*memcnt_utf8_impl_)(const void *, int, size_t) =
+    &MEMCNT_UTF8_FALLBACK;
+
+#define MEMCNT_UTF8_CANDIDATE(implname)                                        \
+    else if (MEMCNT_DCHECK_##implname) memcnt_utf8_impl_ =                     \
+        &MEMCNT_NAME(implname##_utf8);
+
+/* called by memcnt_optimize */
+static void memcnt_utf8_optimize_(void) {
+    if (0)
+        ;
+
+#if MEMCNT_COMPILED_avx512 && defined(MEMCNT_DCHECK_avx512)
+    MEMCNT_UTF8_CANDIDATE(avx512)
+#endif
+
+#if MEMCNT_COMPILED_avx2 && defined(MEMCNT_DCHECK_avx2)
+    MEMCNT_UTF8_CANDIDATE(avx2)
+#endif
+
+#if MEMCNT_COMPILED_sse2 && defined(MEMCNT_DCHECK_sse2)
+    MEMCNT_UTF8_CANDIDATE(sse2)
+#endif
+
+#if MEMCNT_COMPILED_neon && defined(MEMCNT_DCHECK_neon)
+    MEMCNT_UTF8_CANDIDATE(neon)
+#endif
+
+#if MEMCNT_COMPILED_wasm_simd && defined(MEMCNT_DCHECK_wasm_simd)
+    MEMCNT_UTF8_CANDIDATE(wasm_simd)
+#endif
+
+    else
+        memcnt_utf8_impl_ = &MEMCNT_UTF8_FALLBACK;
+}
+
+#define MEMCNT_UTF8_CALL (*memcnt_utf8_impl_)
+#else
+#define MEMCNT_UTF8_CALL MEMCNT_UTF8_PICKED
+#endif
+
+size_t memcnt_utf8_chars(const void *s, size_t n) {
+    return MEMCNT_UTF8_CALL(s, 0xBF, n);
+}
+
+/* the line start is searched for backwards in blocks of this many bytes, so
+   that even long lines are mostly skipped over by memcnt */
+#define MEMCNT_UTF8_BLOCK 256
+
+void memcnt_utf8_pos(const void *s, size_t n, size_t *line, size_t *col) {
+    const unsigned char *p = (const unsigned char *)s;
+    size_t start = n;
+    while (start >= MEMCNT_UTF8_BLOCK &&
+           !memcnt(p + start - MEMCNT_UTF8_BLOCK, '\n', MEMCNT_UTF8_BLOCK))
+        start -= MEMCNT_UTF8_BLOCK;
+    while (start && p[start - 1] != '\n')
+        --start;
+    /* there are no newlines between start and n */
+    if (line)
+        *line = memcnt(p, '\n', start);
+    if (col)
+        *col = MEMCNT_UTF8_CALL(p + start, 0xBF, n - start);
+}
@@ -0,0 +1,76 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* runtime feature probe for picking a memcnt WebAssembly module.
+   a module that uses SIMD will not even load on a runtime without SIMD, so
+   the check has to be done by the host before the module is instantiated.
+   each probe is a minimal module using one instruction of the feature, and
+   WebAssembly.validate tells whether the runtime accepts it. */
+
+"use strict";
+
+/* (func (result v128) (i8x16.popcnt (i8x16.splat (i32.const 0)))) */
+var MEMCNT_PROBE_SIMD = new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1,
+    8, 0, 65, 0, 253, 15, 253, 98, 11
+]);
+
+/* (func (result v128) (i8x16.relaxed_swizzle (i8x16.splat (i32.const 1))
+                                              (i8x16.splat (i32.const 2)))) */
+var MEMCNT_PROBE_RELAXED_SIMD = new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 15, 1,
+    13, 0, 65, 1, 253, 15, 65, 2, 253, 15, 253, 128, 2, 11
+]);
+
+function memcnt_wasm_probe_(bytes) {
+    try {
+        return WebAssembly.validate(bytes);
+    } catch (e) {
+        return false;
+    }
+}
+
+/* returns the first module whose features are supported by the runtime.
+   modules is an object with (any of) the keys "relaxed", "simd" and "base";
+   "base" must be given and is returned if nothing better is supported. */
+function memcnt_wasm_pick(modules) {
+    if (modules.relaxed !== undefined &&
+        memcnt_wasm_probe_(MEMCNT_PROBE_RELAXED_SIMD))
+        return modules.relaxed;
+    if (modules.simd !== undefined && memcnt_wasm_probe_(MEMCNT_PROBE_SIMD))
+        return modules.simd;
+    return modules.base;
+}
+
+if (typeof module !== "undefined" && module.exports)
+    module.exports = { memcnt_wasm_pick: memcnt_wasm_pick };
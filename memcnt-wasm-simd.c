@@ -41,52 +41,105 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define wasm_u8x16_sub wasm_i8x16_sub
 #define wasm_u8x16_eq wasm_i8x16_eq
 #define wasm_u8x16_splat wasm_i8x16_splat
-#define wasm_u16x8_add wasm_i16x8_add
 #define wasm_u32x4_add wasm_i32x4_add
-#define wasm_u64x2_add wasm_i64x2_add
-
-/* not the fastest. anyone have better ideas? */
-INLINE unsigned long long wasm_simd_hsum_u8x16(__u8x16 v) {
-    __u16x8 vh = wasm_u16x8_extend_high_u8x16(v);
-    __u16x8 vl = wasm_u16x8_add(wasm_u16x8_extend_low_u8x16(v), vh);
-    __u32x4 wh = wasm_u32x4_extend_high_u16x8(vl);
-    __u32x4 wl = wasm_u32x4_add(wasm_u32x4_extend_low_u16x8(vl), wh);
-    __u64x2 qh = wasm_u64x2_extend_high_u32x4(wl);
-    __u64x2 ql = wasm_u64x2_add(wasm_u64x2_extend_low_u32x4(wl), qh);
-    return ql[0] + ql[1];
-}
+
+/* with relaxed SIMD, the 8-bit counters can be widened and added with one
+   dot product instead of two pairwise additions. the dot product treats them
+   as signed, so they must be flushed before they reach 128.
+   a module using relaxed SIMD will not load on runtimes without it; see
+   README on building separate modules */
+#if __wasm_relaxed_simd__ && !MEMCNT_NO_WASM_RELAXED
+#define WASM_SIMD_RELAXED 1
+#define WASM_SIMD_FLUSH 127
+#else
+#define WASM_SIMD_RELAXED 0
+#define WASM_SIMD_FLUSH 255
+#endif
+
+/* a 32-bit lane can hold any count that fits a 32-bit size_t, but with
+   memory64 the totals must be moved to c at every flush */
+#if defined(SIZE_MAX) && SIZE_MAX > UINT32_MAX
+#define WASM_SIMD_DRAIN 1
+#else
+#define WASM_SIMD_DRAIN 0
+#endif
 
 INLINE __u8x16 wasm_simd_zero_u8x16(void) {
     return (__u8x16)wasm_i64x2_const(0, 0);
 }
 
-MEMCNT_IMPL(wasm_simd)(const void *ptr, int value, size_t num) {
-    const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
-    size_t c = 0;
-
-    if (num >= 32) {
-        __u8x16 cmp = wasm_u8x16_splat(v), sums = wasm_simd_zero_u8x16();
-        uint8_t j = 1;
-        const __u8x16 *wp;
-        while (NOT_ALIGNED(p, 0x10))
-            --num, c += *p++ == v;
-        wp = (const __u8x16 *)p;
-
-        while (num >= 0x10) {
-            num -= 0x10;
-            sums = wasm_u8x16_sub(sums, wasm_u8x16_eq(cmp, *wp++));
-
-            if (++j == 0) {
-                c += wasm_simd_hsum_u8x16(sums);
-                sums = wasm_simd_zero_u8x16();
-                j = 1;
-            }
-        }
-
-        c += wasm_simd_hsum_u8x16(sums);
-        p = (const unsigned char *)wp;
-    }
-    while (num--)
-        c += *p++ == v;
-    return c;
+/* widens the 8-bit counters in v and adds them to the 32-bit lanes of t */
+INLINE __u32x4 wasm_simd_widen_add_u8x16(__u32x4 t, __u8x16 v) {
+#if WASM_SIMD_RELAXED
+    return wasm_i32x4_relaxed_dot_i8x16_i7x16_add(v, wasm_i8x16_splat(1), t);
+#else
+    return wasm_u32x4_add(t, wasm_u32x4_extadd_pairwise_u16x8(
+                                 wasm_u16x8_extadd_pairwise_u8x16(v)));
+#endif
 }
+
+INLINE size_t wasm_simd_hsum_u32x4(__u32x4 v) {
+    v = wasm_u32x4_add(v, wasm_i32x4_shuffle(v, v, 2, 3, 0, 1));
+    v = wasm_u32x4_add(v, wasm_i32x4_shuffle(v, v, 1, 0, 3, 2));
+    return (size_t)wasm_u32x4_extract_lane(v, 0);
+}
+
+#define SIMD_NAME wasm_simd
+#define SIMD_VEC __u8x16
+#define SIMD_BYTES 0x10
+#define SIMD_TOTAL __u32x4
+#define SIMD_ZERO() wasm_simd_zero_u8x16()
+#define SIMD_TOTAL_ZERO() ((__u32x4)wasm_simd_zero_u8x16())
+#define SIMD_SPLAT(v) wasm_u8x16_splat(v)
+#define SIMD_LOAD(wp) (*(wp))
+#define SIMD_COUNT(s, c, x) wasm_u8x16_sub(s, wasm_u8x16_eq(c, x))
+#define SIMD_FLUSH_ADD(t, s) wasm_simd_widen_add_u8x16(t, s)
+#define SIMD_HSUM(t) wasm_simd_hsum_u32x4(t)
+#define SIMD_FLUSH WASM_SIMD_FLUSH
+#define SIMD_DRAIN WASM_SIMD_DRAIN
+#ifdef UNROLL
+#define SIMD_UNROLL UNROLL
+#else
+#define SIMD_UNROLL 4
+#endif
+#define SIMD_KEEP (MEMCNT_UTF8 || MEMCNT_EQ2)
+#include "memcnt-simd.h"
+
+#if MEMCNT_UTF8
+/* memcnt_wasm_simd_utf8 (for memcnt-utf8.c) is called with c = 0xBF and
+   counts the bytes greater than it as signed chars (-65), which are those
+   that start a UTF-8 character */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME wasm_simd_utf8
+#define SIMD_COUNT(s, c, x) wasm_u8x16_sub(s, wasm_i8x16_gt(x, c))
+#define SIMD_SCALAR(b, v) MEMCNT_UTF8_LEAD(b)
+#define SIMD_KEEP MEMCNT_EQ2
+#include "memcnt-simd.h"
+#endif
+
+#if MEMCNT_EQ2
+/* memcnt_wasm_simd_eq2 and memcnt_wasm_simd_ham (for memcnt-eq2.c) count the
+   equal bytes and the differing bits of two buffers */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#define SIMD_NAME wasm_simd_eq2
+#define SIMD_LOADU(wp) wasm_v128_load(wp)
+#define SIMD_COUNT(s, y, x) wasm_u8x16_sub(s, wasm_u8x16_eq(y, x))
+#define SIMD_KEEP 1
+#include "memcnt-simd2.h"
+
+/* each byte of the counters grows by up to 8 per iteration */
+#undef SIMD_NAME
+#undef SIMD_COUNT
+#undef SIMD_SCALAR
+#undef SIMD_FLUSH
+#define SIMD_NAME wasm_simd_ham
+#define SIMD_COUNT(s, y, x)                                                    \
+    wasm_i8x16_add(s, wasm_i8x16_popcnt(wasm_v128_xor(x, y)))
+#define SIMD_SCALAR(x, y) MEMCNT_BITS8((x) ^ (y))
+#define SIMD_FLUSH (WASM_SIMD_FLUSH / 8)
+#include "memcnt-simd2.h"
+#endif
@@ -42,67 +42,95 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef MEMCNT_WORD
 #error must define MEMCNT_WORD and memcnt_word_t (typedef) for memcnt-wide.c
-#elif CHAR_BIT != 8 || ((MEMCNT_WORD) % 8) != 0
-#error memcnt-wide.c only supported for CHAR_BIT == 8 and MEMCNT_WORD % 8 == 0
+#elif CHAR_BIT != 8 || ((MEMCNT_WORD) % 16) != 0
+#error memcnt-wide.c only supported for CHAR_BIT == 8 and MEMCNT_WORD % 16 == 0
 #else
 
-#if MEMCNT_WORD == 32
-static const memcnt_word_t mask_ = 0x01010101ULL;
-#define POPCOUNT popcount32
-#elif MEMCNT_WORD == 64
-static const memcnt_word_t mask_ = 0x0101010101010101ULL;
-#define POPCOUNT popcount64
-#else
-#error given MEMCNT_WORD value not supported
+#ifndef MEMCNT_COUNT
+#define MEMCNT_COUNT (MEMCNT_WORD / CHAR_BIT)
 #endif
 
-#if __GNUC__
-#define popcount32 __builtin_popcount
-#define popcount64 __builtin_popcountl
-#else
-INLINE int popcount(memcnt_word_t v) {
-    int c = 0;
-    for (; v; ++c)
-        v &= v - 1;
-    return c;
-}
-#define popcount32 popcount
-#define popcount64 popcount
+#ifndef WIDE_UNROLL
+#define WIDE_UNROLL 4
 #endif
 
-#ifndef MEMCNT_COUNT
-#define MEMCNT_COUNT (MEMCNT_WORD / CHAR_BIT)
-#endif
+/* the masks are derived from the word type, so that they work for any word
+   width without needing literals wider than unsigned long (long) */
+/* 0x0101...01, bytes with only their lowest bit set */
+static const memcnt_word_t wide_lo_ = (memcnt_word_t)~(memcnt_word_t)0 / 0xFF;
+/* 0x7F7F...7F */
+static const memcnt_word_t wide_lo7_ =
+    (memcnt_word_t)~(memcnt_word_t)0 / 0xFF * 0x7F;
+/* 0x00FF...00FF */
+static const memcnt_word_t wide_lo16_ =
+    (memcnt_word_t)~(memcnt_word_t)0 / 0xFFFF * 0xFF;
+/* 0x0001...0001 */
+static const memcnt_word_t wide_one16_ =
+    (memcnt_word_t)~(memcnt_word_t)0 / 0xFFFF;
+
+/* returns a word with 01 in every byte that was 00 in x, and 00 elsewhere.
+   adding 7F to the low 7 bits sets the high bit if any of them were set, and
+   ORing with x sets it if the high bit itself was set. this never carries
+   over into the next byte, so (unlike the x - 0x01..01 trick) the result is
+   exact for every byte and can be used for counting */
+INLINE memcnt_word_t wide_zeros_(memcnt_word_t x) {
+    memcnt_word_t t = ((x & wide_lo7_) + wide_lo7_) | x;
+    return (~t >> 7) & wide_lo_;
+}
+
+/* sums up the bytes in a word. the pairwise 16-bit sums are at most 510, and
+   the total (at most 255 * 16) still fits in the top 16 bits for words up to
+   128 bits */
+INLINE size_t wide_hsum_(memcnt_word_t v) {
+    v = (v & wide_lo16_) + ((v >> 8) & wide_lo16_);
+    return (size_t)((v * wide_one16_) >> (MEMCNT_WORD - 16));
+}
 
 MEMCNT_IMPL(wide)(const void *ptr, int value, size_t num) {
     size_t c = 0;
     const unsigned char *p = (unsigned char *)ptr, v = (unsigned char)value;
-    if (num > MEMCNT_WORD * 4) {
-        /* mask = bytes with only their lowest bit set in word */
-        const memcnt_word_t mask = mask_;
-        /* with * mask, we "broadcast" the byte all over the word */
-        memcnt_word_t cmp = (memcnt_word_t)(v * mask), tmp;
+    if (num >= MEMCNT_COUNT * WIDE_UNROLL * 2) {
+        int k;
+        /* with * wide_lo_, we "broadcast" the byte all over the word */
+        memcnt_word_t cmp = (memcnt_word_t)(wide_lo_ * v), sums[WIDE_UNROLL];
+        uint8_t j = 1;
         const memcnt_word_t *wp;
         /* handle unaligned ptr */
-        while ((uintptr_t)p & (MEMCNT_COUNT - 1))
-            --num, c += *p++ == value;
+        while (NOT_ALIGNED(p, MEMCNT_COUNT))
+            --num, c += *p++ == v;
         wp = (const memcnt_word_t *)p;
+
+        /* every byte in sums[k] is a counter of its own, and can be
+           incremented 255 times before it has to be flushed into c */
+        for (k = 0; k < WIDE_UNROLL; ++k)
+            sums[k] = 0;
+        while (num >= MEMCNT_COUNT * WIDE_UNROLL) {
+            num -= MEMCNT_COUNT * WIDE_UNROLL;
+            /* XOR with cmp - now bytes equal to value are 00s */
+            for (k = 0; k < WIDE_UNROLL; ++k)
+                sums[k] += wide_zeros_(wp[k] ^ cmp);
+            wp += WIDE_UNROLL;
+
+            if (++j == 0) {
+                for (k = 0; k < WIDE_UNROLL; ++k)
+                    c += wide_hsum_(sums[k]);
+                for (k = 0; k < WIDE_UNROLL; ++k)
+                    sums[k] = 0;
+                j = 1;
+            }
+        }
+
+        for (k = 0; k < WIDE_UNROLL; ++k)
+            c += wide_hsum_(sums[k]);
+        sums[0] = 0;
+
+        /* at most WIDE_UNROLL - 1 words left, cannot overflow */
         while (num >= MEMCNT_COUNT) {
             num -= MEMCNT_COUNT;
-            /* XOR with cmp - now bytes equal to value are 00s */
-            tmp = *wp++ ^ cmp;
-            /* count zero bytes in word tmp and add to c */
-            /* shifts make sure the low bits in each byte are set if any
-               of the bits in the byte were set */
-            tmp |= tmp >> 4;
-            tmp |= tmp >> 2;
-            tmp |= tmp >> 1;
-            /* masks out anything else but the lowest bits in each byte */
-            tmp &= mask;
-            /* popcount will then give us the number of bytes that weren't 00.
-               subtract from the number of bytes in the word to inverse */
-            c += MEMCNT_COUNT - POPCOUNT(tmp);
+            sums[0] += wide_zeros_(*wp++ ^ cmp);
         }
+
+        c += wide_hsum_(sums[0]);
         /* assign pointer back to handle unaligned again */
         p = (const unsigned char *)wp;
     }
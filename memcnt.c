@@ -36,6 +36,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
    memcnt-*.c files (as well as memcnt.h and memcnt-impl.h) for this to work. */
 
 #include "memcnt.h"
+/* the definitions below must not be replaced by the inline macro */
+#undef memcnt
 
 /* try to test identifier limits */
 #undef MEMCNT_TMP_REALLYLONGNAME2
@@ -76,12 +78,81 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_DYNAMIC 0
 #endif
 
+/* memcnt_utf8_chars and memcnt_utf8_pos (memcnt-utf8.c). define as 0 to
+   leave them out */
+#ifndef MEMCNT_UTF8
+#define MEMCNT_UTF8 1
+#endif
+
+/* memcnt_eq2, memcnt_ne2 and memcnt_hamming (memcnt-eq2.c). define as 0 to
+   leave them out */
+#ifndef MEMCNT_EQ2
+#define MEMCNT_EQ2 1
+#endif
+
+/* memcnt_strided and memcnt_2d (memcnt-strided.c). define as 0 to leave
+   them out */
+#ifndef MEMCNT_STRIDED
+#define MEMCNT_STRIDED 1
+#endif
+
+/* memcnt_capped and memcnt_atleast (memcnt-capped.c). define as 0 to leave
+   them out */
+#ifndef MEMCNT_CAPPED
+#define MEMCNT_CAPPED 1
+#endif
+
+/* memcnt_approx (memcnt-approx.c). define as 0 to leave it out */
+#ifndef MEMCNT_APPROX
+#define MEMCNT_APPROX 1
+#endif
+
+/* memcnt_rank and friends (memcnt-rank.c). they allocate memory, so they are
+   only included by default if there is a <stdlib.h>. define as 0 or 1 to
+   leave them out or force them in */
+#ifndef MEMCNT_RANK
+#if defined(__has_include)
+#if __has_include(<stdlib.h>)
+#define MEMCNT_RANK 1
+#endif
+#elif __STDC_HOSTED__
+#define MEMCNT_RANK 1
+#endif
+#endif
+
+/* memcnt_csv (memcnt-csv.c). define as 0 to leave it out */
+#ifndef MEMCNT_CSV
+#define MEMCNT_CSV 1
+#endif
+
+/* memcnt_pattern and friends (memcnt-pattern.c). define as 0 to leave them
+   out */
+#ifndef MEMCNT_PATTERN
+#define MEMCNT_PATTERN 1
+#endif
+
+/* call statistics of memcnt, read with memcnt_stats (memcnt-stats.c).
+   define as 1 to include them */
+#ifndef MEMCNT_STATS
+#define MEMCNT_STATS 0
+#endif
+
+#if MEMCNT_STATS
+/* the implementations below define memcnt_uncounted_ instead, and the memcnt
+   at the end of this file counts the call before calling it. the calls from
+   the other functions here go straight to memcnt_uncounted_ */
+#define memcnt memcnt_uncounted_
+static size_t memcnt_uncounted_(const void *s, int c, size_t n);
+#endif
+
 /* =============================
     architecture detection code
    ============================= */
 
 /*
    to add a new implementation:
+   0. write memcnt-*.c. SIMD implementations only need to define the vector
+                        primitives and include memcnt-simd.h
    1. add compile-time (and possibly runtime) checks to the
                         compiler-implementation table
    2. add the include to the implementation list
@@ -103,7 +174,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
                             and the architecture check will be done either way
       MEMCNT_DCHECK_*     runtime check. you can call functions etc., but if
                             you define a function, make it static (inline) and
-                            include it from another file */
+                            include it from another file
+   optional:
+      MEMCNT_FLAGS_*      whether the compiler flags enable implementation *,
+                            if MEMCNT_CHECK_* compiles it in regardless (such
+                            as with target attributes). defaults to
+                            MEMCNT_CHECK_*. only these may be called before
+                            memcnt_optimize picks one */
 
 #define MEMCNT_NAME(impl) memcnt_##impl
 
@@ -114,6 +191,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_CHECK_sse2 __SSE2__
 #define MEMCNT_CHECK_avx2 __AVX2__
 #define MEMCNT_CHECK_avx512 __AVX512BW__
+#define MEMCNT_CHECK_pclmul (__PCLMUL__ && __POPCNT__)
 
 #if MEMCNT_DYNAMIC
 #include <immintrin.h>
@@ -121,6 +199,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_DCHECK_sse2 _may_i_use_cpu_feature(_FEATURE_SSE2)
 #define MEMCNT_DCHECK_avx2 _may_i_use_cpu_feature(_FEATURE_AVX2)
 #define MEMCNT_DCHECK_avx512 _may_i_use_cpu_feature(_FEATURE_AVX512BW)
+#define MEMCNT_DCHECK_pclmul                                                   \
+    _may_i_use_cpu_feature(_FEATURE_PCLMULQDQ | _FEATURE_POPCNT)
 #endif
 
 #elif defined(_MSC_VER)
@@ -130,8 +210,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_ARCH_POWER _M_PPC
 
 #define MEMCNT_CHECK_sse2 (_M_IX86_FP == 2 || _M_AMD64 || _M_X64)
+/* MSVC provides the intrinsics regardless of /arch, so with the dynamic
+   dispatcher the AVX implementations can always be compiled in */
+#if MEMCNT_DYNAMIC && _MSC_VER >= 1911 && (_M_AMD64 || _M_X64)
+#define MEMCNT_CHECK_avx2 1
+#define MEMCNT_CHECK_avx512 1
+#define MEMCNT_CHECK_pclmul 1
+#define MEMCNT_FLAGS_avx2 __AVX2__
+#define MEMCNT_FLAGS_avx512 __AVX512BW__
+#else
 #define MEMCNT_CHECK_avx2 __AVX2__
 #define MEMCNT_CHECK_avx512 __AVX512BW__
+/* MSVC has no macro for PCLMULQDQ, but every CPU with AVX has it */
+#define MEMCNT_CHECK_pclmul __AVX__
+#endif
 #define MEMCNT_CHECK_neon __ARM_NEON
 
 #if _MSC_VER >= 1700
@@ -152,9 +244,26 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_ARCH_MIPS __mips__
 #define MEMCNT_ARCH_POWER (__PPC__ || __PPC64__)
 
+/* with the dynamic dispatcher, the x86 implementations are compiled with
+   target attributes, so that a baseline build still contains all of them
+   and can pick any that the CPU supports */
+#if MEMCNT_DYNAMIC && (defined(__clang__) || __GNUC__ >= 5) &&                 \
+    !MEMCNT_NO_TARGET
+#undef MEMCNT_TARGET
+#define MEMCNT_TARGET(isa) __attribute__((target(isa)))
+#define MEMCNT_CHECK_sse2 1
+#define MEMCNT_CHECK_avx2 1
+#define MEMCNT_CHECK_avx512 1
+#define MEMCNT_CHECK_pclmul 1
+#define MEMCNT_FLAGS_sse2 __SSE2__
+#define MEMCNT_FLAGS_avx2 __AVX2__
+#define MEMCNT_FLAGS_avx512 __AVX512BW__
+#else
 #define MEMCNT_CHECK_sse2 __SSE2__
 #define MEMCNT_CHECK_avx2 __AVX2__
 #define MEMCNT_CHECK_avx512 __AVX512BW__
+#define MEMCNT_CHECK_pclmul (__PCLMUL__ && __POPCNT__)
+#endif
 #define MEMCNT_CHECK_neon __ARM_NEON
 #define MEMCNT_CHECK_wasm_simd __wasm_simd128__
 
@@ -173,6 +282,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_STDINT MEMCNT_C99
 #endif
 
+#ifndef MEMCNT_FLAGS_sse2
+#define MEMCNT_FLAGS_sse2 MEMCNT_CHECK_sse2
+#endif
+#ifndef MEMCNT_FLAGS_avx2
+#define MEMCNT_FLAGS_avx2 MEMCNT_CHECK_avx2
+#endif
+#ifndef MEMCNT_FLAGS_avx512
+#define MEMCNT_FLAGS_avx512 MEMCNT_CHECK_avx512
+#endif
+
 #ifndef MEMCNT_CAN_MULTIARCH
 #if defined(UINTPTR_MAX)
 #define MEMCNT_CAN_MULTIARCH 1
@@ -219,7 +338,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* order from "most desirable" to "least desirable" within the same arch */
 
 /* all compiled impls must define MEMCNT_COMPILED_* to 1 and
-    MEMCNT_PICKED to themselves if not already defined */
+    MEMCNT_PICKED to themselves if not already defined, as well as
+    MEMCNT_INITIAL if the compiler flags enable them (MEMCNT_FLAGS_*).
+    the dynamic dispatcher starts with MEMCNT_INITIAL, which is safe to call
+    on any CPU the program was compiled for */
 
 /* Intel AVX-512(BW) */
 #if MEMCNT_COMPILE_FOR(X86, avx512)
@@ -228,6 +350,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(avx512)
 #endif
+#if MEMCNT_FLAGS_avx512 && !defined(MEMCNT_INITIAL)
+#define MEMCNT_INITIAL MEMCNT_NAME(avx512)
+#endif
 #endif
 
 /* Intel AVX2 */
@@ -237,6 +362,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(avx2)
 #endif
+#if MEMCNT_FLAGS_avx2 && !defined(MEMCNT_INITIAL)
+#define MEMCNT_INITIAL MEMCNT_NAME(avx2)
+#endif
 #endif
 
 /* Intel SSE2 */
@@ -246,6 +374,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(sse2)
 #endif
+#if MEMCNT_FLAGS_sse2 && !defined(MEMCNT_INITIAL)
+#define MEMCNT_INITIAL MEMCNT_NAME(sse2)
+#endif
 #endif
 
 /* ARM Neon */
@@ -255,6 +386,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(neon)
 #endif
+#ifndef MEMCNT_INITIAL
+#define MEMCNT_INITIAL MEMCNT_NAME(neon)
+#endif
 #endif
 
 /* WebAssembly SIMD */
@@ -264,6 +398,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(wasm_simd)
 #endif
+#ifndef MEMCNT_INITIAL
+#define MEMCNT_INITIAL MEMCNT_NAME(wasm_simd)
+#endif
 #endif
 
 #endif
@@ -284,8 +421,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEMCNT_WIDE 0
 #endif
 
+/* MEMCNT_WIDE128 uses unsigned __int128 as the word if the compiler has it.
+   this is effectively a 2x unroll on 64-bit targets and may or may not be
+   faster depending on the compiler; off by default */
+#ifndef MEMCNT_WIDE128
+#define MEMCNT_WIDE128 0
+#endif
+
 #if MEMCNT_WIDE
-#if defined(UINT64_MAX) && UINTPTR_MAX > UINT32_MAX
+#if MEMCNT_WIDE128 && defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 memcnt_word_t;
+#define MEMCNT_WORD 128
+#define MEMCNT_COUNT 16
+#elif defined(UINT64_MAX) && UINTPTR_MAX > UINT32_MAX
 typedef uint64_t memcnt_word_t;
 #define MEMCNT_WORD 64
 #define MEMCNT_COUNT 8
@@ -310,18 +458,55 @@ typedef uint32_t memcnt_word_t;
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(wide)
 #endif
+#ifndef MEMCNT_INITIAL
+#define MEMCNT_INITIAL MEMCNT_NAME(wide)
+#endif
 #endif
 
 #ifndef MEMCNT_PICKED
 #undef MEMCNT_DEFAULT
-#ifdef __cplusplus
 #define MEMCNT_DEFAULT size_t memcnt
-#endif
 #include "memcnt-default.c"
 #elif MEMCNT_DYNAMIC
 #include "memcnt-default.c"
 #endif
 
+#if MEMCNT_UTF8
+#include "memcnt-utf8.c"
+#endif
+
+#if MEMCNT_EQ2
+#include "memcnt-eq2.c"
+#endif
+
+#if MEMCNT_STRIDED
+#include "memcnt-strided.c"
+#endif
+
+#if MEMCNT_CAPPED
+#include "memcnt-capped.c"
+#endif
+
+#if MEMCNT_APPROX
+#include "memcnt-approx.c"
+#endif
+
+#if MEMCNT_RANK
+#include "memcnt-rank.c"
+#endif
+
+#if MEMCNT_CSV || MEMCNT_PATTERN
+#include "memcnt-mask.c"
+#endif
+
+#if MEMCNT_CSV
+#include "memcnt-csv.c"
+#endif
+
+#if MEMCNT_PATTERN
+#include "memcnt-pattern.c"
+#endif
+
 /* =============================
             dispatchers
    ============================= */
@@ -334,13 +519,20 @@ size_t memcnt(const void *s, int c, size_t n) { return MEMCNT_PICKED(s, c, n); }
 #ifndef MEMCNT_PICKED
 #define MEMCNT_PICKED MEMCNT_NAME(default)
 #endif
+#ifndef MEMCNT_INITIAL
+#define MEMCNT_INITIAL MEMCNT_PICKED
+#endif
+
+#if MEMCNT_STATS
+#include "memcnt-stats.c"
+#endif
 
 /* dynamic dispatcher */
 #if MEMCNT_MULTIARCH && MEMCNT_DYNAMIC
 /* size_t memcnt(const void *s, int c, size_t n); */
 typedef size_t (*memcnt_implptr_t)(const void *, int, size_t);
 
-static memcnt_implptr_t memcnt_impl_;
+static memcnt_implptr_t memcnt_impl_ = &MEMCNT_INITIAL;
 
 /* debug info */
 #if MEMCNT_DEBUG
@@ -357,10 +549,19 @@ memcnt_implptr_t memcnt_impl_choose_(memcnt_implptr_t fp, const char *s) {
     return fp;
 }
 
-#define MEMCNT_DYNAMIC_CHOOSE(x)                                               \
+#define MEMCNT_DYNAMIC_CHOOSE_(x)                                              \
     memcnt_impl_choose_(&(MEMCNT_NAME(x)), "memcnt_" #x)
 #else
-#define MEMCNT_DYNAMIC_CHOOSE(x) &(MEMCNT_NAME(x))
+#define MEMCNT_DYNAMIC_CHOOSE_(x) &(MEMCNT_NAME(x))
+#endif
+
+/* the statistics are kept under the name of the implementation */
+#if MEMCNT_STATS
+static const char *memcnt_stats_chosen_;
+#define MEMCNT_DYNAMIC_CHOOSE(x)                                               \
+    (memcnt_stats_chosen_ = "memcnt_" #x, MEMCNT_DYNAMIC_CHOOSE_(x))
+#else
+#define MEMCNT_DYNAMIC_CHOOSE(x) MEMCNT_DYNAMIC_CHOOSE_(x)
 #endif
 
 #define MEMCNT_DYNAMIC_CANDIDATE(implname)                                     \
@@ -403,10 +604,26 @@ void memcnt_optimize(void) {
         p = MEMCNT_DYNAMIC_CHOOSE(default);
 #endif
     memcnt_impl_ = p;
+#if MEMCNT_STATS
+    memcnt_stats_resolve_(memcnt_stats_chosen_);
+#endif
+#if MEMCNT_UTF8
+    memcnt_utf8_optimize_();
+#endif
+#if MEMCNT_EQ2
+    memcnt_eq2_optimize_();
+#endif
+#if MEMCNT_STRIDED
+    memcnt_strided_optimize_();
+#endif
+#if MEMCNT_CSV
+    memcnt_csv_optimize_();
+#endif
+#if MEMCNT_PATTERN
+    memcnt_pattern_optimize_();
+#endif
 }
 
-static memcnt_implptr_t memcnt_impl_ = &MEMCNT_PICKED;
-
 size_t memcnt(const void *s, int c, size_t n) {
     return (*memcnt_impl_)(s, c, n);
 }
@@ -445,8 +662,15 @@ void memcnt_optimize(void) {}
 
 /* debug info */
 #if MEMCNT_DEBUG
-/* name of "best" implementation compiled in */
-const char *memcnt_impl_name_ = STRINGIFYVAL(MEMCNT_PICKED);
+/* name of the implementation memcnt calls before memcnt_optimize */
+const char *memcnt_impl_name_ = STRINGIFYVAL(MEMCNT_INITIAL);
+#endif
+
+#if MEMCNT_STATS
+#undef memcnt
+size_t memcnt(const void *s, int c, size_t n) {
+    return memcnt_stats_count_(s, c, n);
+}
 #endif
 
 #endif
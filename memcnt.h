@@ -84,8 +84,210 @@ PUBLIC size_t memcnt(const void *s, int c, size_t n);
    you probably don't have to worry about calling this -- see README */
 void memcnt_optimize(void);
 
+/* Counts the UTF-8 characters in the initial n bytes of the array pointed to
+   by s, that is, the bytes that are not continuation bytes (0x80-0xBF). The
+   text is not validated; each invalid byte outside 0x80-0xBF counts as one
+   character. */
+PUBLIC size_t memcnt_utf8_chars(const void *s, size_t n);
+
+/* Finds the line and column of byte offset n in the UTF-8 text pointed to by
+   s and stores them into *line and *col (either may be NULL). Both start from
+   zero: the line is the number of newlines ('\n') in the initial n bytes, and
+   the column is the number of characters between the last of them and offset
+   n (not the display width, which depends on tabs and the characters). */
+PUBLIC void memcnt_utf8_pos(const void *s, size_t n, size_t *line,
+                            size_t *col);
+
+/* Counts the positions at which the initial n bytes of the arrays pointed to
+   by a and b are equal (memcnt_eq2) or differ (memcnt_ne2). */
+PUBLIC size_t memcnt_eq2(const void *a, const void *b, size_t n);
+PUBLIC size_t memcnt_ne2(const void *a, const void *b, size_t n);
+
+/* Counts the bits that differ between the initial n bytes of the arrays
+   pointed to by a and b (the Hamming distance). */
+PUBLIC size_t memcnt_hamming(const void *a, const void *b, size_t n);
+
+/* Like memcnt, but stops counting once cap bytes equal to c have been found,
+   and returns at most cap. */
+PUBLIC size_t memcnt_capped(const void *s, int c, size_t n, size_t cap);
+
+/* Returns 1 if there are at least k bytes equal to c (converted to an
+   unsigned char) in the initial n bytes of s, else 0. Stops counting as soon
+   as the answer is known. */
+PUBLIC int memcnt_atleast(const void *s, int c, size_t n, size_t k);
+
+/* Estimates the number of bytes equal to c (converted to an unsigned char)
+   in the initial n bytes of s by counting a sample of blocks spread over the
+   buffer. The estimate is within rel_error of the true count (such as 0.005
+   for 0.5%) with the given probability (confidence, from 0.5 to 0.9999); the
+   absolute error bound is stored into *bound (unless it is NULL). Buffers
+   too small or with too few matches for sampling to pay off are counted in
+   full, with a bound of 0. */
+PUBLIC size_t memcnt_approx(const void *s, int c, size_t n, double rel_error,
+                            double confidence, size_t *bound);
+
+/* An index for counting the bytes equal to a value before any offset of a
+   buffer in O(log n), which can be kept up to date as the buffer is edited
+   by recounting only the parts that changed. The index does not keep a
+   pointer to the buffer; each call takes s, the buffer as it is now (after
+   the edit for the functions that report one). */
+struct memcnt_rank;
+
+/* Creates an index of the bytes equal to c (converted to an unsigned char)
+   in the initial n bytes of s. Returns NULL if out of memory. */
+PUBLIC struct memcnt_rank *memcnt_rank_new(const void *s, size_t n, int c);
+
+/* Frees an index created by memcnt_rank_new. */
+PUBLIC void memcnt_rank_free(struct memcnt_rank *r);
+
+/* Returns the number of bytes equal to the value in the initial pos bytes
+   (or the whole buffer if it is shorter). */
+PUBLIC size_t memcnt_rank(const struct memcnt_rank *r, const void *s,
+                          size_t pos);
+
+/* Returns the number of bytes equal to the value in the whole buffer. */
+PUBLIC size_t memcnt_rank_total(const struct memcnt_rank *r);
+
+/* Tells the index that k bytes starting from pos were overwritten. */
+PUBLIC void memcnt_rank_update(struct memcnt_rank *r, const void *s,
+                               size_t pos, size_t k);
+
+/* Tells the index that k bytes were inserted at pos. */
+PUBLIC void memcnt_rank_insert(struct memcnt_rank *r, const void *s,
+                               size_t pos, size_t k);
+
+/* Tells the index that k bytes starting from pos were erased. */
+PUBLIC void memcnt_rank_erase(struct memcnt_rank *r, const void *s,
+                              size_t pos, size_t k);
+
+/* Counts the elements equal to c (converted to an unsigned char) among count
+   bytes that are stride bytes apart, starting from s, such as one channel of
+   interleaved data. The array must extend at least (count - 1) * stride + 1
+   bytes from s. */
+PUBLIC size_t memcnt_strided(const void *s, int c, size_t count,
+                             size_t stride);
+
+/* Counts the bytes equal to c (converted to an unsigned char) in a 2D region
+   of height rows of width bytes each, with the rows starting pitch bytes
+   apart from s. */
+PUBLIC size_t memcnt_2d(const void *s, int c, size_t width, size_t height,
+                        size_t pitch);
+
+/* Counts the delimiters c and the newlines ('\n') outside of double-quoted
+   fields in the initial n bytes of the CSV text pointed to by s. Returns the
+   number of delimiters and stores the number of newlines into *lines (unless
+   it is NULL). *quoted is 1 if s starts inside quotes, 0 at the start of the
+   input, and is set to the state at the end of the text, so that text can be
+   counted in chunks. Escaped quotes ("") need no special handling. c must
+   not be '"'. */
+PUBLIC size_t memcnt_csv(const void *s, int c, size_t n, size_t *lines,
+                         int *quoted);
+
+/* the longest pattern memcnt_pattern can count */
+#define MEMCNT_PATTERN_MAX 8
+
+/* Counts the occurrences of the patlen bytes at pat in the initial n bytes of
+   the array pointed to by s, including those that overlap ("aa" occurs twice
+   in "aaa"). patlen must be between 1 and MEMCNT_PATTERN_MAX; otherwise,
+   returns 0. */
+PUBLIC size_t memcnt_pattern(const void *s, size_t n, const void *pat,
+                             size_t patlen);
+
+/* Like memcnt_pattern, but counts the occurrences that do not overlap,
+   starting from the leftmost ("aa" occurs once in "aaa" and twice in
+   "aaaa"). */
+PUBLIC size_t memcnt_pattern_disjoint(const void *s, size_t n,
+                                      const void *pat, size_t patlen);
+
+/* state for counting a pattern in chunks; the members are private */
+struct memcnt_pattern_state {
+    unsigned char pat[MEMCNT_PATTERN_MAX], held[MEMCNT_PATTERN_MAX - 1];
+    unsigned char len, nheld, skip, disjoint;
+};
+
+/* Starts counting the pattern (as memcnt_pattern_disjoint if disjoint is
+   non-zero, otherwise as memcnt_pattern) in chunks. memcnt_pattern_next then
+   counts the occurrences that end in each consecutive chunk, including those
+   that start in an earlier one, so that the sum over all chunks is the count
+   for the whole input. */
+PUBLIC void memcnt_pattern_begin(struct memcnt_pattern_state *st,
+                                 const void *pat, size_t patlen,
+                                 int disjoint);
+PUBLIC size_t memcnt_pattern_next(struct memcnt_pattern_state *st,
+                                  const void *s, size_t n);
+
+/* the number of size classes in struct memcnt_stats_impl, enough for a
+   64-bit size_t */
+#define MEMCNT_STATS_BUCKETS 65
+/* the number of implementations memcnt_stats reports, the one memcnt starts
+   with and the one picked by memcnt_optimize */
+#define MEMCNT_STATS_IMPLS 2
+
+/* Statistics of the calls to memcnt with one implementation, since the
+   program started. */
+struct memcnt_stats_impl {
+    /* the name of the implementation, such as "memcnt_avx2", or NULL if
+       memcnt has not used this entry */
+    const char *name;
+    /* the number of calls and the bytes counted by them */
+    size_t calls, bytes;
+    /* the number of calls by size: sizes[0] for zero bytes, and sizes[k]
+       for 2^(k-1) to 2^k - 1 bytes */
+    size_t sizes[MEMCNT_STATS_BUCKETS];
+    /* the calls that were timed (one in MEMCNT_STATS_SAMPLE, if defined for
+       memcnt.c), the bytes counted by them and the time they took, in
+       cycles on x86 and in ticks of the generic timer on ARM */
+    size_t sampled_calls, sampled_bytes;
+    double sampled_ticks;
+};
+
+struct memcnt_stats {
+    struct memcnt_stats_impl impl[MEMCNT_STATS_IMPLS];
+    /* the number of threads that have called memcnt, including those that
+       have since exited */
+    size_t threads;
+};
+
+/* Stores the statistics of the calls to memcnt from all threads into *st.
+   Only available if memcnt.c was compiled with MEMCNT_STATS=1 (and not
+   with memcnt-strict.c). The statistics may be read while other threads
+   call memcnt, but then each count may or may not include calls that were
+   made while the statistics were read. */
+PUBLIC void memcnt_stats(struct memcnt_stats *st);
+
 #ifdef __cplusplus
 }
 #endif
 
+/* calls with a size that is a compile-time constant of at most
+   MEMCNT_INLINE_MAX bytes can be counted inline instead of calling memcnt
+   (with memcnt_fixed and memcnt<c> of memcnt.hpp in C++, and in C with GCC
+   and clang if MEMCNT_INLINE is defined as 1, which makes memcnt a macro).
+   the compiler then unrolls the loop for the size and value, and there is no
+   call or dispatch. define MEMCNT_NO_INLINE to always call memcnt. */
+#if MEMCNT_NO_INLINE
+#undef MEMCNT_INLINE_MAX
+#define MEMCNT_INLINE_MAX 0
+#elif !defined(MEMCNT_INLINE_MAX)
+#define MEMCNT_INLINE_MAX 64
+#endif
+
+/* the macro is opt-in, since a program that defines its own memcnt (such as
+   a dispatcher for MEMCNT_NAMED implementations) could not be compiled */
+#if MEMCNT_INLINE && !defined(__cplusplus) && defined(__GNUC__) &&             \
+    MEMCNT_INLINE_MAX > 0
+static __inline__ size_t memcnt_inline_(const void *s, int c, size_t n) {
+    const unsigned char *p = (const unsigned char *)s, v = (unsigned char)c;
+    size_t i, count = 0;
+    for (i = 0; i < n; ++i)
+        count += p[i] == v;
+    return count;
+}
+
+#define memcnt(s, c, n)                                                        \
+    (__builtin_constant_p(n) && (n) <= MEMCNT_INLINE_MAX                       \
+         ? memcnt_inline_((s), (c), (n))                                       \
+         : (memcnt)((s), (c), (n)))
+#endif
+
 #endif /* MEMCNT_H */
@@ -0,0 +1,330 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef MEMCNT_HPP
+#define MEMCNT_HPP
+
+/* C++ overloads of memcnt for spans, string views and contiguous ranges.
+   elements one byte wide are counted by memcnt (and thus by the fastest
+   implementation available); wider integer and enum elements are counted
+   with a loop written so that the compiler can vectorize it. during constant
+   evaluation, everything is counted with the loop, so the overloads can be
+   used to count compile-time tables.
+
+   memcnt<c>(s, n) counts a constant value and memcnt_fixed<n>(s, c) a
+   constant size; either is counted inline without calling memcnt when the
+   size is known at compile time and at most MEMCNT_INLINE_MAX (see memcnt.h).
+
+   memcnt_async counts a large buffer from a coroutine in slices, letting
+   other work run on the same thread in between (see below).
+
+   memcnt<c> and memcnt_fixed need C++11, the string_view overload C++17 and
+   everything else C++20. */
+
+#ifndef __cplusplus
+#error memcnt.hpp is for C++ only, use memcnt.h in C
+#endif
+
+#include "memcnt.h"
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define MEMCNT_CONSTANT_P(x) __builtin_constant_p(x)
+#else
+#define MEMCNT_CONSTANT_P(x) false
+#endif
+
+#if defined(__cpp_lib_is_constant_evaluated)
+#include <type_traits>
+#define MEMCNT_CONSTEXPR constexpr
+#define MEMCNT_IS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#else
+#define MEMCNT_CONSTEXPR inline
+#define MEMCNT_IS_CONSTANT_EVALUATED() false
+#endif
+
+#if defined(__cpp_lib_string_view)
+#include <string_view>
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
+#if defined(__cpp_lib_ranges) && defined(__cpp_concepts)
+#include <concepts>
+#include <ranges>
+#include <type_traits>
+#endif
+#if defined(__cpp_lib_coroutine)
+#include <coroutine>
+#include <exception>
+#include <utility>
+#endif
+
+/* the number of bytes memcnt_async counts between suspensions, about 50 to
+   100 microseconds of work */
+#ifndef MEMCNT_ASYNC_SLICE
+#define MEMCNT_ASYNC_SLICE ((std::size_t)1 << 20)
+#endif
+
+namespace memcnt_detail {
+
+template <std::size_t N> struct uint_of { typedef std::size_t type; };
+template <> struct uint_of<2> { typedef std::uint16_t type; };
+template <> struct uint_of<4> { typedef std::uint32_t type; };
+template <> struct uint_of<8> { typedef std::uint64_t type; };
+
+template <typename T>
+MEMCNT_CONSTEXPR std::size_t count_loop(const T *s, T c,
+                                        std::size_t n) noexcept {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n; ++i)
+        count += s[i] == c;
+    return count;
+}
+
+/* counts in blocks of a fixed size into a counter as wide as the elements,
+   which GCC and clang vectorize even at -O2 */
+template <typename T>
+inline std::size_t count_wide(const T *s, T c, std::size_t n) noexcept {
+    typedef typename uint_of<sizeof(T)>::type block_t;
+    std::size_t count = 0, i = 0;
+    for (; i + 64 <= n; i += 64) {
+        block_t block = 0;
+        for (std::size_t j = 0; j < 64; ++j)
+            block += s[i + j] == c;
+        count += block;
+    }
+    return count + count_loop(s + i, c, n - i);
+}
+
+/* T must be an integer or enum type */
+template <typename T>
+MEMCNT_CONSTEXPR std::size_t count(const T *s, T c, std::size_t n) noexcept {
+    if (MEMCNT_IS_CONSTANT_EVALUATED())
+        return count_loop(s, c, n);
+    if (sizeof(T) != 1)
+        return count_wide(s, c, n);
+    return ::memcnt(s, static_cast<unsigned char>(c), n);
+}
+
+/* like count, but inline also for bytes if n is a small constant */
+template <typename T>
+inline std::size_t count_inline(const T *s, T c, std::size_t n) noexcept {
+    if (sizeof(T) == 1 && MEMCNT_CONSTANT_P(n) && n <= MEMCNT_INLINE_MAX)
+        return count_loop(s, c, n);
+    return count(s, c, n);
+}
+
+} // namespace memcnt_detail
+
+/* counts the bytes equal to C in the initial n bytes of s */
+template <int C>
+inline std::size_t memcnt(const void *s, std::size_t n) noexcept {
+    return memcnt_detail::count_inline(static_cast<const unsigned char *>(s),
+                                       static_cast<unsigned char>(C), n);
+}
+
+/* counts the bytes equal to c in the initial N bytes of s */
+template <std::size_t N>
+inline std::size_t memcnt_fixed(const void *s, int c) noexcept {
+    if (N <= MEMCNT_INLINE_MAX)
+        return memcnt_detail::count_loop(static_cast<const unsigned char *>(s),
+                                         static_cast<unsigned char>(c), N);
+    return ::memcnt(s, c, N);
+}
+
+#if defined(__cpp_lib_string_view)
+MEMCNT_CONSTEXPR std::size_t memcnt(std::string_view s, char c) noexcept {
+    return memcnt_detail::count(s.data(), c, s.size());
+}
+#endif
+
+#if defined(__cpp_lib_span)
+MEMCNT_CONSTEXPR std::size_t memcnt(std::span<const std::byte> s,
+                                    std::byte c) noexcept {
+    return memcnt_detail::count(s.data(), c, s.size());
+}
+#endif
+
+#if defined(__cpp_lib_ranges) && defined(__cpp_concepts)
+namespace memcnt_detail {
+
+template <typename T>
+concept element = std::is_integral_v<T> || std::is_enum_v<T>;
+
+} // namespace memcnt_detail
+
+/* counts the elements of a contiguous range (such as an array, a vector or
+   a string) equal to c. a string literal is an array that includes its
+   terminating null, so memcnt("abc", '\0') is 1; count a std::string_view
+   of it to leave the null out */
+template <std::ranges::contiguous_range R>
+    requires std::ranges::sized_range<R> &&
+             memcnt_detail::element<std::ranges::range_value_t<R>>
+MEMCNT_CONSTEXPR std::size_t
+memcnt(R &&r, std::type_identity_t<std::ranges::range_value_t<R>> c) noexcept {
+    return memcnt_detail::count(
+        static_cast<const std::ranges::range_value_t<R> *>(
+            std::ranges::data(r)),
+        c, static_cast<std::size_t>(std::ranges::size(r)));
+}
+
+/* counts the elements of a contiguous range equal to C, such as
+   memcnt<'\n'>(str) */
+template <auto C, std::ranges::contiguous_range R>
+    requires std::ranges::sized_range<R> &&
+             memcnt_detail::element<std::ranges::range_value_t<R>>
+MEMCNT_CONSTEXPR std::size_t memcnt(R &&r) noexcept {
+    typedef std::ranges::range_value_t<R> T;
+    const T *s = static_cast<const T *>(std::ranges::data(r));
+    std::size_t n = static_cast<std::size_t>(std::ranges::size(r));
+    if (MEMCNT_IS_CONSTANT_EVALUATED())
+        return memcnt_detail::count_loop(s, static_cast<T>(C), n);
+    return memcnt_detail::count_inline(s, static_cast<T>(C), n);
+}
+#endif
+
+#if defined(__cpp_lib_coroutine)
+/* the result of memcnt_async: co_await it for the count. the count starts
+   when the task is awaited and resumes the awaiting coroutine when done */
+class memcnt_task {
+  public:
+    struct promise_type {
+        std::size_t value = 0;
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        memcnt_task get_return_object() noexcept {
+            return memcnt_task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                return h.promise().continuation;
+            }
+            void await_resume() noexcept {}
+        };
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_value(std::size_t v) noexcept { value = v; }
+        void unhandled_exception() noexcept {
+            error = std::current_exception();
+        }
+    };
+
+    memcnt_task(memcnt_task &&t) noexcept : h_(std::exchange(t.h_, {})) {}
+    memcnt_task &operator=(memcnt_task &&t) noexcept {
+        if (this != &t) {
+            if (h_)
+                h_.destroy();
+            h_ = std::exchange(t.h_, {});
+        }
+        return *this;
+    }
+    ~memcnt_task() {
+        if (h_)
+            h_.destroy();
+    }
+
+    /* a task can only be awaited once, and not after it has been moved from */
+    bool await_ready() const noexcept { return h_.done(); }
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    std::size_t await_resume() {
+        if (h_.promise().error)
+            std::rethrow_exception(h_.promise().error);
+        return h_.promise().value;
+    }
+
+  private:
+    explicit memcnt_task(std::coroutine_handle<promise_type> h) noexcept
+        : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+namespace memcnt_detail {
+
+/* suspends and hands the coroutine to the scheduler to resume later */
+template <typename Scheduler> struct reschedule {
+    Scheduler &sched;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) { sched(h); }
+    void await_resume() const noexcept {}
+};
+
+} // namespace memcnt_detail
+
+/* counts the bytes equal to c in the initial n bytes of s like memcnt, but
+   in slices of the given size, suspending between them so that a long count
+   does not hold up the thread. sched is called with the coroutine to resume
+   after each slice, and would usually post it to the executor of the caller
+   (to let the other tasks on it run first) or to a thread pool (to count
+   there); e.g. with Asio,
+
+       std::size_t lines = co_await memcnt_async(
+           p, '\n', n, [ex](std::coroutine_handle<> h) { asio::post(ex, h); });
+
+   counts of at most one slice never suspend. the buffer must stay valid
+   until the count is done, and if sched resumes the coroutine on another
+   thread, the awaiting coroutine is also resumed there. */
+template <typename Scheduler>
+memcnt_task memcnt_async(const void *s, int c, std::size_t n, Scheduler sched,
+                         std::size_t slice = MEMCNT_ASYNC_SLICE) {
+    const unsigned char *p = static_cast<const unsigned char *>(s);
+    std::size_t count = 0;
+    if (!slice)
+        slice = n;
+    for (;;) {
+        std::size_t k = n < slice ? n : slice;
+        count += ::memcnt(p, c, k);
+        p += k, n -= k;
+        if (!n)
+            co_return count;
+        co_await memcnt_detail::reschedule<Scheduler>{sched};
+    }
+}
+#endif
+
+#endif /* MEMCNT_HPP */
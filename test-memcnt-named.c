@@ -0,0 +1,99 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* tests the manual setup described in README: a program that includes
+   memcnt.h, compiles implementations with MEMCNT_NAMED=1 and provides its
+   own memcnt to dispatch between them. this file includes the
+   implementations and thus should be compiled on its own */
+
+#include <limits.h>
+#include <stdio.h>
+
+#define MEMCNT_C 0
+#define MEMCNT_NAMED 1
+#include "memcnt.h"
+
+#include "memcnt-default.c"
+
+/* memcnt-wide.c needs the machine word */
+typedef unsigned long memcnt_word_t;
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define MEMCNT_WORD 64
+#else
+#define MEMCNT_WORD 32
+#endif
+#include "memcnt-wide.c"
+
+static int use_wide = 0;
+
+/* the dispatcher. memcnt.h must not turn this into a macro call */
+size_t memcnt(const void *s, int c, size_t n) {
+    return use_wide ? memcnt_wide(s, c, n) : memcnt_default(s, c, n);
+}
+
+static unsigned char buf[4096];
+
+int main(void) {
+    size_t i, n, expect;
+    int c, fails = 0;
+
+    for (i = 0; i < sizeof(buf); ++i)
+        buf[i] = (unsigned char)(i * 7 % 13);
+
+    for (use_wide = 0; use_wide < 2; ++use_wide) {
+        /* a constant size, which the inline macro would have taken */
+        if (memcnt("a\nb\n", '\n', 4) != 2) {
+            printf("FAIL: constant size with %s\n",
+                   use_wide ? "memcnt_wide" : "memcnt_default");
+            ++fails;
+        }
+        for (c = 0; c < 14; ++c) {
+            for (n = 0; n <= sizeof(buf); n += 97) {
+                expect = 0;
+                for (i = 0; i < n; ++i)
+                    expect += buf[i] == c;
+                if (memcnt(buf, c, n) != expect) {
+                    printf("FAIL: memcnt(buf, %d, %lu) with %s\n", c,
+                           (unsigned long)n,
+                           use_wide ? "memcnt_wide" : "memcnt_default");
+                    ++fails;
+                }
+            }
+        }
+    }
+
+    if (fails)
+        return 1;
+    puts("All named dispatch tests passed");
+    return 0;
+}
@@ -133,9 +133,19 @@ typedef int cputime_t;
 cputime_t getcputime(void) { return 0; }
 #endif
 
+#if defined(__linux__) && !PAPI && !NO_PERF
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#if defined(SYS_perf_event_open)
+#define PERF 1
+#endif
+#endif
+
 #if PAPI
 #include <papi.h>
 #define BM4_OK 1
+#define BM4_METHOD "PAPI"
 int papi_evt[] = {PAPI_TOT_CYC};
 #define PAPI_EVENTS_COUNT (sizeof(papi_evt) / sizeof(papi_evt[0]))
 long long papi_val[PAPI_EVENTS_COUNT] = {0};
@@ -163,12 +173,60 @@ void bm4_init(void) {
 unsigned long long bm4_get_cyclecount(void) {
     return (unsigned long long)papi_val[0];
 }
+unsigned long long bm4_get_instrcount(void) { return 0; }
+#elif PERF
+#define BM4_OK 1
+#define BM4_METHOD "Linux perf_event_open"
+/* cycles (group leader) and instructions, counted in user mode only */
+int perf_fd[2] = {-1, -1};
+unsigned long long perf_val[2] = {0};
+int perf_open(unsigned long long config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+void bm4_init(void) {
+    perf_fd[0] = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (perf_fd[0] < 0) {
+        perror("\nperf_event_open");
+        puts("Hardware counters are not available. "
+             "Try checking /proc/sys/kernel/perf_event_paranoid");
+        abort();
+    }
+    /* optional */
+    perf_fd[1] = perf_open(PERF_COUNT_HW_INSTRUCTIONS, perf_fd[0]);
+}
+void bm4_start(void) {
+    ioctl(perf_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+void bm4_stop(void) {
+    unsigned long long data[3] = {0};
+    ioctl(perf_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (read(perf_fd[0], data, sizeof(data)) < (ssize_t)sizeof(data[0])) {
+        perror("\nperf_event_open read");
+        abort();
+    }
+    perf_val[0] = data[0] >= 1 ? data[1] : 0;
+    perf_val[1] = data[0] >= 2 ? data[2] : 0;
+}
+unsigned long long bm4_get_cyclecount(void) { return perf_val[0]; }
+unsigned long long bm4_get_instrcount(void) { return perf_val[1]; }
 #else
 #define BM4_OK 0
+#define BM4_METHOD "(none)"
 void bm4_init(void) {}
 void bm4_start(void) {}
 void bm4_stop(void) {}
 unsigned long long bm4_get_cyclecount(void) { return 0; }
+unsigned long long bm4_get_instrcount(void) { return 0; }
 #endif
 
 #if IS_WINDOWS
@@ -280,6 +338,486 @@ void fill_array(int arraySize, int tryCount, int *tries, int *counts,
 
 static void free_buf(void) { free(buf); }
 
+#if MEMCNT_C && MEMCNT_UTF8
+/* tests memcnt_utf8_chars and memcnt_utf8_pos on random text with a mix of
+   ASCII, multibyte characters and newlines. returns 0 if OK */
+static int test_utf8(void) {
+    static const char *const chars[] = {"a", "\n", "\xC3\xA4", "\xE2\x82\xAC",
+                                        "\xF0\x9F\x98\x80"};
+    size_t n = 0, i, j, line, col, trueLine, trueCol;
+    while (n < 20000) {
+        const char *c = chars[rng() % 5];
+        while (*c)
+            buf[n++] = (unsigned char)*c++;
+    }
+    for (i = 0; i < 300; ++i) {
+        size_t start = (size_t)rng() % 64, end = start + (size_t)rng() % 8000;
+        size_t trueCount = 0;
+        if (i < 64)
+            end = start + i;
+        for (j = start; j < end; ++j)
+            trueCount += (buf[j] & 0xC0) != 0x80;
+        if (memcnt_utf8_chars(buf + start, end - start) != trueCount) {
+            printf("memcnt_utf8_chars(buf + %zu, %zu) returned %zu, "
+                   "should be %zu\n",
+                   start, end - start,
+                   memcnt_utf8_chars(buf + start, end - start), trueCount);
+            return 1;
+        }
+        trueLine = trueCol = 0;
+        for (j = 0; j < end; ++j) {
+            if (buf[j] == '\n')
+                ++trueLine, trueCol = 0;
+            else
+                trueCol += (buf[j] & 0xC0) != 0x80;
+        }
+        memcnt_utf8_pos(buf, end, &line, &col);
+        if (line != trueLine || col != trueCol) {
+            printf("memcnt_utf8_pos(buf, %zu) returned %zu:%zu, should be "
+                   "%zu:%zu\n",
+                   end, line, col, trueLine, trueCol);
+            return 1;
+        }
+    }
+    /* a long line, so that the line start is searched for in blocks */
+    memset(buf, 'a', 5000);
+    buf[100] = '\n';
+    memcnt_utf8_pos(buf, 5000, &line, &col);
+    if (line != 1 || col != 4899) {
+        printf("memcnt_utf8_pos on a long line returned %zu:%zu, should be "
+               "1:4899\n",
+               line, col);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_EQ2
+/* tests memcnt_eq2, memcnt_ne2 and memcnt_hamming on two random buffers that
+   are mostly equal, at different alignments. returns 0 if OK */
+static int test_eq2(void) {
+    size_t n = 20000, i, count, trueEq, trueBits;
+    unsigned char *a = buf, *b = buf + n + 64;
+    int k;
+    for (k = 0; k < 8; ++k) {
+        size_t oa = (size_t)rng() % 64, ob = k & 1 ? oa : (size_t)rng() % 64;
+        trueEq = trueBits = 0;
+        for (i = 0; i < n; ++i) {
+            unsigned x = (unsigned)rng() & 0xFF, y = x;
+            if (rng() % 4 == 0)
+                y = k & 2 ? x ^ 0xFF : (unsigned)rng() & 0xFF;
+            a[oa + i] = (unsigned char)x, b[ob + i] = (unsigned char)y;
+            trueEq += x == y;
+            for (y ^= x; y; y >>= 1)
+                trueBits += y & 1;
+        }
+
+        count = memcnt_eq2(a + oa, b + ob, n);
+        if (count != trueEq) {
+            printf("memcnt_eq2 returned %zu; should be %zu\n", count, trueEq);
+            return 1;
+        }
+        count = memcnt_ne2(a + oa, b + ob, n);
+        if (count != n - trueEq) {
+            printf("memcnt_ne2 returned %zu; should be %zu\n", count,
+                   n - trueEq);
+            return 1;
+        }
+        count = memcnt_hamming(a + oa, b + ob, n);
+        if (count != trueBits) {
+            printf("memcnt_hamming returned %zu; should be %zu\n", count,
+                   trueBits);
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_CAPPED
+/* tests memcnt_capped and memcnt_atleast around the true count of a value in
+   a buffer long enough to be counted in several chunks. returns 0 if OK */
+static int test_capped(void) {
+    size_t n = 200000, i, count, trueCount = 0, k;
+    static const size_t deltas[] = {0, 1, 2, 1000, 20000};
+    for (i = 0; i < n; ++i)
+        trueCount += (buf[i] = (unsigned char)(rng() % 8)) == 0;
+
+    for (i = 0; i < sizeof(deltas) / sizeof(deltas[0]); ++i) {
+        for (k = trueCount - deltas[i]; k <= trueCount + deltas[i];
+             k += deltas[i] ? 2 * deltas[i] : 1) {
+            size_t trueCapped = trueCount < k ? trueCount : k;
+            int atleast = memcnt_atleast(buf, 0, n, k);
+            count = memcnt_capped(buf, 0, n, k);
+            if (count != trueCapped) {
+                printf("memcnt_capped returned %zu for cap %zu; should be "
+                       "%zu\n",
+                       count, k, trueCapped);
+                return 1;
+            }
+            if (atleast != (trueCount >= k)) {
+                printf("memcnt_atleast returned %d for %zu; should be %d\n",
+                       atleast, k, trueCount >= k);
+                return 1;
+            }
+        }
+    }
+    if (memcnt_capped(buf, 0, n, 0) != 0 || !memcnt_atleast(buf, 0, 0, 0) ||
+        memcnt_atleast(buf, 0, 0, 1)) {
+        puts("memcnt_capped or memcnt_atleast failed with a zero size");
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_APPROX
+/* tests that memcnt_approx keeps to its error bound on random data whose
+   density changes along the buffer, and counts small buffers exactly. since
+   the estimate may miss the bound by chance (1 in 10000 times here), the
+   test only fails if it misses it twice over. returns 0 if OK */
+static int test_approx(void) {
+    size_t n = TEST_ARRAY_SIZE, i, trueCount = 0, count, bound, diff;
+    for (i = 0; i < n; ++i)
+        trueCount += (buf[i] = (unsigned char)(rng() % (4 + i / 50000))) == 0;
+
+    count = memcnt_approx(buf, 0, n, 0.05, 0.9999, &bound);
+    diff = count > trueCount ? count - trueCount : trueCount - count;
+    if (diff > 2 * bound || bound > trueCount / 10) {
+        printf("memcnt_approx returned %zu with bound %zu; should be %zu\n",
+               count, bound, trueCount);
+        return 1;
+    }
+
+    trueCount = memcnt(buf, 0, 10000);
+    count = memcnt_approx(buf, 0, 10000, 0.05, 0.95, &bound);
+    if (count != trueCount || bound != 0) {
+        printf("memcnt_approx returned %zu with bound %zu for a small buffer; "
+               "should be %zu with bound 0\n",
+               count, bound, trueCount);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_RANK
+/* tests memcnt_rank after each of a series of random inserts, erases and
+   overwrites of random data, some of them large enough to split or merge
+   blocks. returns 0 if OK */
+static int test_rank(void) {
+    size_t n = 200000, i, op, pos, k, count, trueCount;
+    struct memcnt_rank *r;
+    for (i = 0; i < n; ++i)
+        buf[i] = (unsigned char)(rng() % 4);
+    r = memcnt_rank_new(buf, n, 1);
+    if (!r) {
+        puts("memcnt_rank_new failed");
+        return 1;
+    }
+
+    for (op = 0; op < 3000; ++op) {
+        pos = (size_t)rng() % (n + 1);
+        k = (size_t)rng() % (op % 10 ? 100 : 20000);
+        switch (rng() % 3) {
+        case 0:
+            if (n + k > TEST_ARRAY_SIZE)
+                k = TEST_ARRAY_SIZE - n;
+            memmove(buf + pos + k, buf + pos, n - pos);
+            for (i = 0; i < k; ++i)
+                buf[pos + i] = (unsigned char)(rng() % 4);
+            n += k;
+            memcnt_rank_insert(r, buf, pos, k);
+            break;
+        case 1:
+            if (k > n - pos)
+                k = n - pos;
+            memmove(buf + pos, buf + pos + k, n - pos - k);
+            n -= k;
+            memcnt_rank_erase(r, buf, pos, k);
+            break;
+        case 2:
+            if (k > n - pos)
+                k = n - pos;
+            for (i = 0; i < k; ++i)
+                buf[pos + i] = (unsigned char)(rng() % 4);
+            memcnt_rank_update(r, buf, pos, k);
+            break;
+        }
+
+        for (i = 0; i < 3; ++i) {
+            pos = i ? (size_t)rng() % (n + 1) : n;
+            trueCount = memcnt(buf, 1, pos);
+            count = i ? memcnt_rank(r, buf, pos) : memcnt_rank_total(r);
+            if (count != trueCount) {
+                printf("memcnt_rank returned %zu at %zu of %zu after %zu "
+                       "edits; should be %zu\n",
+                       count, pos, n, op + 1, trueCount);
+                memcnt_rank_free(r);
+                return 1;
+            }
+        }
+    }
+    memcnt_rank_free(r);
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_STATS
+/* tests that memcnt_stats counts calls of a few sizes into the right size
+   classes. returns 0 if OK */
+#if MEMCNT_STATS_PTHREAD
+/* each thread of test_stats makes the same calls */
+static void *test_stats_thread(void *arg) {
+    size_t n;
+    for (n = 0; n < 100; ++n)
+        (void)memcnt(buf, 0, n);
+    return arg;
+}
+
+/* runs threads four at a time, twice as many as there are slots, so that
+   they must give their slots back when they exit. returns 0 if OK */
+static int test_stats_threads(void) {
+    struct memcnt_stats before, after;
+    const struct memcnt_stats_slot_ *shared = MEMCNT_STATS_SHARED_;
+    size_t i, k, calls = 0, bytes = 0, threads = 2 * MEMCNT_STATS_THREADS;
+    pthread_t th[4];
+    memcnt_stats(&before);
+    for (i = 0; i < threads; i += 4) {
+        for (k = 0; k < 4; ++k) {
+            if (pthread_create(&th[k], NULL, &test_stats_thread, NULL)) {
+                puts("could not create a thread for the statistics tests");
+                return 1;
+            }
+        }
+        for (k = 0; k < 4; ++k)
+            pthread_join(th[k], NULL);
+    }
+    memcnt_stats(&after);
+
+    for (k = 0; k < MEMCNT_STATS_IMPLS; ++k) {
+        calls += after.impl[k].calls - before.impl[k].calls;
+        bytes += after.impl[k].bytes - before.impl[k].bytes;
+        if (shared->impl[k].calls) {
+            printf("%zu calls went to the shared slot; the threads did not "
+                   "give their slots back\n",
+                   shared->impl[k].calls);
+            return 1;
+        }
+    }
+    if (after.threads - before.threads != threads || calls != threads * 100 ||
+        bytes != threads * (99 * 100 / 2)) {
+        printf("memcnt_stats counted %zu calls of %zu bytes from %zu "
+               "threads; should be %zu calls from %zu threads\n",
+               calls, bytes, after.threads - before.threads, threads * 100,
+               threads);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+static int test_stats(void) {
+    static const size_t sizes[] = {0, 1, 2, 3, 100, 4096, 65535, 65536};
+    struct memcnt_stats before, after;
+    size_t i, k, calls = 0, bytes = 0, n;
+    size_t expected[MEMCNT_STATS_BUCKETS] = {0};
+    int b;
+    memcnt_stats(&before);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        (void)memcnt(buf, 0, sizes[i]);
+        for (b = 0, n = sizes[i]; n; n >>= 1)
+            ++b;
+        ++expected[b];
+    }
+    memcnt_stats(&after);
+
+    if (!after.impl[0].name || !after.threads) {
+        puts("memcnt_stats did not name the implementation or the thread");
+        return 1;
+    }
+    for (b = 0; b < MEMCNT_STATS_BUCKETS; ++b) {
+        n = 0;
+        for (k = 0; k < MEMCNT_STATS_IMPLS; ++k)
+            n += after.impl[k].sizes[b] - before.impl[k].sizes[b];
+        if (n != expected[b]) {
+            printf("memcnt_stats counted %zu calls in size class %d; should "
+                   "be %zu\n",
+                   n, b, expected[b]);
+            return 1;
+        }
+    }
+    for (k = 0; k < MEMCNT_STATS_IMPLS; ++k) {
+        calls += after.impl[k].calls - before.impl[k].calls;
+        bytes += after.impl[k].bytes - before.impl[k].bytes;
+    }
+    if (calls != i || bytes != 0 + 1 + 2 + 3 + 100 + 4096 + 65535 + 65536) {
+        printf("memcnt_stats counted %zu calls of %zu bytes; should be %zu "
+               "calls\n",
+               calls, bytes, i);
+        return 1;
+    }
+    /* once memcnt_optimize has picked another implementation, the calls
+       are counted under it */
+    if (after.impl[1].name && after.impl[0].calls != before.impl[0].calls) {
+        printf("memcnt_stats counted calls under %s after memcnt_optimize "
+               "picked %s\n",
+               after.impl[0].name, after.impl[1].name);
+        return 1;
+    }
+#if MEMCNT_STATS_PTHREAD
+    return test_stats_threads();
+#else
+    return 0;
+#endif
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_STRIDED
+/* tests memcnt_strided with every stride up to 9 and memcnt_2d with a few
+   region sizes on random data of few different values. returns 0 if OK */
+static int test_strided(void) {
+    size_t n = 20000, i, j, count, trueCount, stride, width, height;
+    for (i = 0; i < n + 64; ++i)
+        buf[i] = (unsigned char)(rng() % 3);
+
+    for (stride = 0; stride <= 9; ++stride) {
+        size_t off = (size_t)rng() % 64, elems = (size_t)rng() % 2000;
+        if (stride)
+            elems = n / stride - (size_t)rng() % 16;
+        trueCount = 0;
+        for (i = 0; i < elems; ++i)
+            trueCount += buf[off + i * stride] == 1;
+        count = memcnt_strided(buf + off, 1, elems, stride);
+        if (count != trueCount) {
+            printf("memcnt_strided returned %zu for stride %zu; should be "
+                   "%zu\n",
+                   count, stride, trueCount);
+            return 1;
+        }
+    }
+
+    for (width = 1; width <= 1000; width += 333) {
+        height = n / (width + 5);
+        trueCount = 0;
+        for (i = 0; i < height; ++i)
+            for (j = 0; j < width; ++j)
+                trueCount += buf[i * (width + 5) + j] == 2;
+        count = memcnt_2d(buf, 2, width, height, width + 5);
+        if (count != trueCount) {
+            printf("memcnt_2d returned %zu for width %zu; should be %zu\n",
+                   count, width, trueCount);
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_CSV
+/* tests memcnt_csv on random CSV-like text, both in one call and in chunks
+   of random sizes. returns 0 if OK */
+static int test_csv(void) {
+    static const char chars[] = "a,\n\"";
+    size_t n = 20000, i, chunk, count, lines, countLines, trueCount = 0,
+           trueLines = 0;
+    int quoted = 0, trueQuoted = 0;
+    for (i = 0; i < n; ++i) {
+        buf[i] = (unsigned char)chars[rng() % 4];
+        if (buf[i] == '"')
+            trueQuoted = !trueQuoted;
+        else if (!trueQuoted)
+            trueCount += buf[i] == ',', trueLines += buf[i] == '\n';
+    }
+
+    count = memcnt_csv(buf, ',', n, &lines, &quoted);
+    if (count != trueCount || lines != trueLines || quoted != trueQuoted) {
+        printf("memcnt_csv returned %zu, %zu lines, quoted=%d; should be "
+               "%zu, %zu lines, quoted=%d\n",
+               count, lines, quoted, trueCount, trueLines, trueQuoted);
+        return 1;
+    }
+
+    count = countLines = 0;
+    quoted = 0;
+    for (i = 0; i < n; i += chunk) {
+        chunk = (size_t)rng() % 700 + 1;
+        if (chunk > n - i)
+            chunk = n - i;
+        count += memcnt_csv(buf + i, ',', chunk, &lines, &quoted);
+        countLines += lines;
+    }
+    if (count != trueCount || countLines != trueLines ||
+        quoted != trueQuoted) {
+        printf("memcnt_csv in chunks returned %zu, %zu lines, quoted=%d; "
+               "should be %zu, %zu lines, quoted=%d\n",
+               count, countLines, quoted, trueCount, trueLines, trueQuoted);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+#if MEMCNT_C && MEMCNT_PATTERN
+/* counts the occurrences of pat in buf one position at a time */
+static size_t count_pattern(size_t n, const char *pat, size_t len,
+                            int disjoint) {
+    size_t i = 0, count = 0;
+    while (i + len <= n)
+        if (!memcmp(buf + i, pat, len))
+            ++count, i += disjoint ? len : 1;
+        else
+            ++i;
+    return count;
+}
+
+/* tests memcnt_pattern, memcnt_pattern_disjoint and the chunked versions on
+   random text of few different characters, with patterns that can and
+   cannot overlap. returns 0 if OK */
+static int test_pattern(void) {
+    static const char chars[] = "ab\r\n";
+    static const char *const pats[] = {"\r\n", "aa",     "aba", "ab\r\n",
+                                       "abab", "aaaaaaa", "a\r\nab\r\nb"};
+    size_t n = 20000, i, chunk, count, trueCount, len;
+    struct memcnt_pattern_state st;
+    int k, disjoint;
+    for (i = 0; i < n; ++i)
+        buf[i] = (unsigned char)chars[rng() % (i < n / 2 ? 2 : 4)];
+
+    for (k = 0; k < (int)(sizeof(pats) / sizeof(pats[0])); ++k) {
+        len = strlen(pats[k]);
+        for (disjoint = 0; disjoint <= 1; ++disjoint) {
+            trueCount = count_pattern(n, pats[k], len, disjoint);
+            count = disjoint ? memcnt_pattern_disjoint(buf, n, pats[k], len)
+                             : memcnt_pattern(buf, n, pats[k], len);
+            if (count != trueCount) {
+                printf("memcnt_pattern%s returned %zu for pattern %d; should "
+                       "be %zu\n",
+                       disjoint ? "_disjoint" : "", count, k, trueCount);
+                return 1;
+            }
+
+            count = 0;
+            memcnt_pattern_begin(&st, pats[k], len, disjoint);
+            for (i = 0; i < n; i += chunk) {
+                chunk = (size_t)rng() % (rng() % 2 ? 8 : 700);
+                if (chunk > n - i)
+                    chunk = n - i;
+                count += memcnt_pattern_next(&st, buf + i, chunk);
+            }
+            if (count != trueCount) {
+                printf("memcnt_pattern_next%s returned %zu for pattern %d; "
+                       "should be %zu\n",
+                       disjoint ? " (disjoint)" : "", count, k, trueCount);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
 int main(int argc, char *argv[]) {
     int t, i, tries[CHAR_COUNT], counts[CHAR_COUNT], batchNum, tryCount;
     size_t arraySize, arraySizeIter, trueCount, testCount;
@@ -348,10 +886,12 @@ int main(int argc, char *argv[]) {
         timeinit();
     } else if (benchmark == 4) {
 #if !BM4_OK
-        puts("Benchmark 4 not supported on this build (must define PAPI=1)");
+        puts("Benchmark 4 not supported on this build (must define PAPI=1 "
+             "or run on Linux)");
         return 1;
 #else
-        puts("Benchmark: measuring perf counters via PAPI");
+        puts("Benchmark: measuring perf counters");
+        puts("              method: " BM4_METHOD);
 #endif
         bm4_init();
     } else if (benchmark) {
@@ -479,6 +1019,51 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
         }
+#if MEMCNT_C && MEMCNT_UTF8
+        puts("Running UTF-8 tests");
+        if (test_utf8())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_EQ2
+        puts("Running buffer comparison tests");
+        if (test_eq2())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_CAPPED
+        puts("Running threshold tests");
+        if (test_capped())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_APPROX
+        puts("Running approximate count tests");
+        if (test_approx())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_RANK
+        puts("Running rank index tests");
+        if (test_rank())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_STRIDED
+        puts("Running strided tests");
+        if (test_strided())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_CSV
+        puts("Running CSV tests");
+        if (test_csv())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_PATTERN
+        puts("Running pattern tests");
+        if (test_pattern())
+            return 1;
+#endif
+#if MEMCNT_C && MEMCNT_STATS
+        puts("Running statistics tests");
+        if (test_stats())
+            return 1;
+#endif
         puts("Running random stress tests");
     }
     if (benchmark)
@@ -586,12 +1171,15 @@ int main(int argc, char *argv[]) {
                         unsigned long long interval_bm1 =
                             testEnd_bm1 - testStart_bm1;
                         unsigned long long cycles = bm4_get_cyclecount();
+                        unsigned long long instrs = bm4_get_instrcount();
                         printf("OK     | %11llu cyc | ", cycles);
                         if (arraySize > 10 && cycles > 0)
-                            printf("%11.2f B/cyc\n",
-                                   arraySize / (double)cycles);
+                            printf("%11.2f B/cyc", arraySize / (double)cycles);
                         else
-                            puts("-");
+                            printf("-");
+                        if (instrs > 0 && cycles > 0)
+                            printf(" (%.2f IPC)", instrs / (double)cycles);
+                        putchar('\n');
                         bm_large = interval_bm1 * 1000000ULL / CLOCKS_PER_SEC <
                                    LARGE_ARRAY_THRESHOLD_MS * 1000ULL;
                     }
@@ -0,0 +1,273 @@
+/*
+
+memcnt -- C function for counting bytes equal to value in a buffer
+Copyright (c) 2021 Sampo Hippeläinen (hisahi)
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* tests for memcnt.hpp. like test-memcnt.c, this file includes memcnt.c and
+   thus should be compiled on its own, e.g. g++ -std=c++20 test-memcnt.cpp.
+   the tests for the features the standard does not have are left out */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "memcnt.hpp"
+
+#include "memcnt.c"
+
+#if defined(__cpp_lib_ranges) && defined(__cpp_concepts) &&                    \
+    defined(__cpp_lib_is_constant_evaluated)
+#include <array>
+
+constexpr std::array<short, 6> test_table = {1, 2, 1, 3, 1, 4};
+static_assert(memcnt(test_table, 1) == 3, "constexpr count of a range");
+static_assert(memcnt(std::string_view("a\nb\nc"), '\n') == 2,
+              "constexpr count of a string_view");
+static_assert(memcnt<1>(test_table) == 3, "constexpr count of a constant");
+#endif
+
+static unsigned char test_text[256];
+
+/* memcnt_fixed<N> and memcnt<c> against memcnt. returns 0 if OK */
+template <std::size_t N> static int test_fixed() {
+    std::size_t expect = ::memcnt(test_text, '\n', N);
+    if (memcnt_fixed<N>(test_text, '\n') != expect ||
+        memcnt<'\n'>(test_text, N) != expect) {
+        std::printf("memcnt_fixed<%zu> or memcnt<'\\n'> returned %zu and "
+                    "%zu; should be %zu\n",
+                    N, memcnt_fixed<N>(test_text, '\n'),
+                    memcnt<'\n'>(test_text, N), expect);
+        return 1;
+    }
+    return 0;
+}
+
+/* sizes on both sides of MEMCNT_INLINE_MAX (64). returns 0 if OK */
+static int test_inline() {
+    for (std::size_t i = 0; i < sizeof(test_text); ++i)
+        test_text[i] = i % 5 == 3 ? '\n' : 'x';
+    if (test_fixed<0>() || test_fixed<1>() || test_fixed<4>() ||
+        test_fixed<63>() || test_fixed<64>() || test_fixed<65>() ||
+        test_fixed<256>())
+        return 1;
+
+    /* a size that is not a compile-time constant */
+    for (std::size_t n = 0; n <= sizeof(test_text); n += 17) {
+        if (memcnt<'\n'>(test_text, n) != ::memcnt(test_text, '\n', n)) {
+            std::printf("memcnt<'\\n'> of %zu bytes returned the wrong "
+                        "count\n",
+                        n);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#if defined(__cpp_lib_ranges) && defined(__cpp_concepts)
+static unsigned rng_state = 1;
+
+/* a small LCG, enough for filling the buffers */
+static unsigned rng() {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 16;
+}
+
+enum class test_color : unsigned char { red, green, blue };
+
+/* counts typed ranges of random values against std::count, with lengths
+   around the blocks of 64 elements of memcnt_detail::count_wide. returns 0
+   if OK */
+template <typename T> static int test_typed(const char *name) {
+    for (std::size_t n = 0; n < 300; n += 1 + n / 8) {
+        std::vector<T> v(n);
+        for (std::size_t i = 0; i < n; ++i)
+            v[i] = static_cast<T>(rng() % 3);
+        for (unsigned k = 0; k < 3; ++k) {
+            T c = static_cast<T>(k);
+            std::size_t expect =
+                static_cast<std::size_t>(std::count(v.begin(), v.end(), c));
+            if (memcnt(v, c) != expect) {
+                std::printf("memcnt of a vector of %s with %zu elements "
+                            "returned %zu; should be %zu\n",
+                            name, n, memcnt(v, c), expect);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* returns 0 if OK */
+static int test_ranges() {
+    if (test_typed<unsigned char>("unsigned char") ||
+        test_typed<std::uint16_t>("uint16_t") ||
+        test_typed<std::int32_t>("int32_t") ||
+        test_typed<std::uint64_t>("uint64_t") ||
+        test_typed<test_color>("enum class"))
+        return 1;
+
+    /* a string literal is an array and includes its terminating null */
+    if (memcnt("abc", '\0') != 1 ||
+        memcnt(std::string_view("abc"), '\0') != 0) {
+        std::puts("memcnt of a string literal or a string_view counted the "
+                  "wrong number of nulls");
+        return 1;
+    }
+
+    std::vector<std::byte> bytes(1000, std::byte{7});
+    bytes[10] = bytes[999] = std::byte{0};
+    if (memcnt(std::span<const std::byte>(bytes), std::byte{0}) != 2) {
+        std::puts("memcnt of a span of bytes returned the wrong count");
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+#if defined(__cpp_lib_coroutine)
+#include <deque>
+#include <stdexcept>
+
+/* a coroutine that starts at once and is destroyed by its caller, to await
+   memcnt_async from */
+struct test_root {
+    struct promise_type {
+        test_root get_return_object() noexcept {
+            return test_root{
+                std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> h;
+};
+
+/* the scheduler of the tests: a queue of coroutines run in order */
+static std::deque<std::coroutine_handle<>> test_queue;
+static std::size_t test_posts;
+
+static void test_post(std::coroutine_handle<> h) {
+    ++test_posts;
+    test_queue.push_back(h);
+}
+
+static void test_throw(std::coroutine_handle<>) {
+    throw std::runtime_error("cannot schedule");
+}
+
+static test_root test_await(const unsigned char *s, std::size_t n,
+                            std::size_t slice, std::size_t *count) {
+    *count = co_await memcnt_async(s, '\n', n, &test_post, slice);
+}
+
+static test_root test_await_throw(const unsigned char *s, std::size_t n,
+                                  int *threw) {
+    try {
+        (void)co_await memcnt_async(s, '\n', n, &test_throw, 100);
+    } catch (const std::runtime_error &) {
+        *threw = 1;
+    }
+}
+
+/* runs two counts in slices on one queue at once, a count of one slice and
+   one whose scheduler throws. returns 0 if OK */
+static int test_async() {
+    std::vector<unsigned char> v(10000);
+    for (std::size_t i = 0; i < v.size(); ++i)
+        v[i] = i % 7 == 0 ? '\n' : 'x';
+    std::size_t expect = ::memcnt(v.data(), '\n', v.size()), a = 0, b = 0;
+
+    test_posts = 0;
+    test_root ra = test_await(v.data(), v.size(), 1000, &a);
+    test_root rb = test_await(v.data(), v.size(), 3000, &b);
+    if (ra.h.done() || rb.h.done() || test_queue.size() != 2) {
+        std::puts("memcnt_async did not suspend after the first slice");
+        return 1;
+    }
+    while (!test_queue.empty()) {
+        std::coroutine_handle<> h = test_queue.front();
+        test_queue.pop_front();
+        h.resume();
+    }
+    bool done = ra.h.done() && rb.h.done();
+    ra.h.destroy();
+    rb.h.destroy();
+    /* 9 suspensions between 10 slices and 3 between 4 */
+    if (!done || a != expect || b != expect || test_posts != 9 + 3) {
+        std::printf("memcnt_async returned %zu and %zu after %zu "
+                    "suspensions; should be %zu after 12\n",
+                    a, b, test_posts, expect);
+        return 1;
+    }
+
+    test_posts = 0;
+    test_root rc = test_await(v.data(), 1000, 1000, &a);
+    done = rc.h.done();
+    rc.h.destroy();
+    if (!done || test_posts || a != ::memcnt(v.data(), '\n', 1000)) {
+        std::puts("memcnt_async of one slice suspended or miscounted");
+        return 1;
+    }
+
+    int threw = 0;
+    test_root rd = test_await_throw(v.data(), v.size(), &threw);
+    done = rd.h.done();
+    rd.h.destroy();
+    if (!done || !threw) {
+        std::puts("memcnt_async did not pass on the exception of its "
+                  "scheduler");
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+int main() {
+    memcnt_optimize();
+    std::puts("Running inline tests");
+    if (test_inline())
+        return EXIT_FAILURE;
+#if defined(__cpp_lib_ranges) && defined(__cpp_concepts)
+    std::puts("Running range tests");
+    if (test_ranges())
+        return EXIT_FAILURE;
+#endif
+#if defined(__cpp_lib_coroutine)
+    std::puts("Running coroutine tests");
+    if (test_async())
+        return EXIT_FAILURE;
+#endif
+    std::puts("All C++ tests passed");
+    return EXIT_SUCCESS;
+}